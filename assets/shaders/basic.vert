@@ -6,8 +6,14 @@ layout (location = 1) in vec2 v_texCoord;
 out vec2 f_texCoord;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
+
+// Shared by every program (CameraUniforms in graphics.hpp)
+layout (std140) uniform Camera
+{
+    mat4 proj;
+    mat4 view;
+    vec2 viewSize;
+};
 
 void main()
 {
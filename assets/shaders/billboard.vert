@@ -0,0 +1,38 @@
+#version 330 core
+
+layout (location = 0) in vec3 v_pos;
+layout (location = 1) in vec2 v_texCoord;
+
+// xyz = position, w = frame
+layout (location = 2) in vec4 i_posFrame;
+
+out vec2 f_texCoord;
+
+// Shared by every program (CameraUniforms in graphics.hpp)
+layout (std140) uniform Camera
+{
+    mat4 proj;
+    mat4 view;
+    vec2 viewSize;
+};
+
+// Rotation of every billboard around y (so they face the camera)
+uniform float yaw;
+
+// Size of a frame in texture space and frames per row of the sheet
+uniform vec2 frameSize;
+uniform int columns;
+
+void main()
+{
+    int frame = int(i_posFrame.w + 0.5);
+
+    f_texCoord = (vec2(frame % columns, frame / columns) + v_texCoord) * frameSize;
+
+    float c = cos(yaw);
+    float s = sin(yaw);
+
+    vec3 pos = vec3(v_pos.x * c + v_pos.z * s, v_pos.y, -v_pos.x * s + v_pos.z * c);
+
+    gl_Position = proj * view * vec4(pos + i_posFrame.xyz, 1.0);
+}
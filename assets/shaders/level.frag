@@ -0,0 +1,26 @@
+#version 330 core
+
+in vec2 f_tilePos;
+flat in vec2 f_tileOrigin;
+flat in vec2 f_tileExtent;
+
+out vec3 color;
+
+uniform sampler2D tex;
+
+void main()
+{
+    // Merged quads span several tiles, so wrap inside the atlas tile.
+    // The gradients come from the unwrapped position so mip selection
+    // doesn't jump at the seams.
+    vec2 texCoord = f_tileOrigin + fract(f_tilePos) * f_tileExtent;
+
+    vec2 dx = dFdx(f_tilePos) * f_tileExtent;
+    vec2 dy = dFdy(f_tilePos) * f_tileExtent;
+
+    vec4 texCol = textureGrad(tex, texCoord, dx, dy);
+
+    if(texCol.a < 0.1)
+        discard;
+    color = texCol.rgb;
+}
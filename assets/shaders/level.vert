@@ -0,0 +1,29 @@
+#version 330 core
+
+layout (location = 0) in vec3 v_pos;
+layout (location = 1) in vec2 v_tilePos;
+layout (location = 2) in vec2 v_tileOrigin;
+layout (location = 3) in vec2 v_tileExtent;
+
+out vec2 f_tilePos;
+flat out vec2 f_tileOrigin;
+flat out vec2 f_tileExtent;
+
+uniform mat4 model;
+
+// Shared by every program (CameraUniforms in graphics.hpp)
+layout (std140) uniform Camera
+{
+    mat4 proj;
+    mat4 view;
+    vec2 viewSize;
+};
+
+void main()
+{
+    f_tilePos = v_tilePos;
+    f_tileOrigin = v_tileOrigin;
+    f_tileExtent = v_tileExtent;
+
+    gl_Position = proj * view * model * vec4(v_pos, 1.0);
+}
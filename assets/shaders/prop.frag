@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec2 f_texCoord;
+flat in float f_variant;
+
+out vec3 color;
+
+// One per variant (PROP_MAX_VARIANTS). Samplers can only be indexed by
+// constants here, so every variant is sampled and the right one picked.
+uniform sampler2D tex[2];
+
+void main()
+{
+    vec4 texCol = mix(texture(tex[0], f_texCoord), texture(tex[1], f_texCoord), step(0.5, f_variant));
+
+    if(texCol.a < 0.1)
+        discard;
+    color = texCol.rgb;
+}
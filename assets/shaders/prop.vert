@@ -0,0 +1,27 @@
+#version 330 core
+
+layout (location = 0) in vec3 v_pos;
+layout (location = 1) in vec2 v_texCoord;
+
+// Takes up locations 2-5
+layout (location = 2) in mat4 i_model;
+layout (location = 6) in float i_variant;
+
+out vec2 f_texCoord;
+flat out float f_variant;
+
+// Shared by every program (CameraUniforms in graphics.hpp)
+layout (std140) uniform Camera
+{
+    mat4 proj;
+    mat4 view;
+    vec2 viewSize;
+};
+
+void main()
+{
+    f_texCoord = v_texCoord;
+    f_variant = i_variant;
+
+    gl_Position = proj * view * i_model * vec4(v_pos, 1.0);
+}
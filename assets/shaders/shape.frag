@@ -1,10 +1,10 @@
 #version 330 core
 
-out vec3 o_color;
+flat in vec3 f_color;
 
-uniform vec3 color;
+out vec3 o_color;
 
 void main()
 {
-    o_color = color;
+    o_color = f_color;
 }
@@ -1,11 +1,21 @@
 #version 330 core
 
 layout (location = 0) in vec2 v_pos;
+layout (location = 2) in vec3 v_color;
 
-uniform vec2 viewSize;
+flat out vec3 f_color;
+
+// Shared by every program (CameraUniforms in graphics.hpp)
+layout (std140) uniform Camera
+{
+    mat4 proj;
+    mat4 view;
+    vec2 viewSize;
+};
 
 void main() 
 {
+    f_color = v_color;
     gl_Position = vec4(2.0 * (v_pos.x / viewSize.x) - 1.0, 
                        1.0 - 2.0 * (v_pos.y / viewSize.y), 
                        0.0, 1.0);
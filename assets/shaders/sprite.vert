@@ -5,7 +5,13 @@ layout (location = 1) in vec2 v_texCoord;
 
 out vec2 f_texCoord;
 
-uniform vec2 viewSize;
+// Shared by every program (CameraUniforms in graphics.hpp)
+layout (std140) uniform Camera
+{
+    mat4 proj;
+    mat4 view;
+    vec2 viewSize;
+};
 
 void main() 
 {
@@ -1,10 +1,11 @@
 #version 330 core
 
 in vec2 f_texCoord;
+flat in vec3 f_tint;
+
 out vec3 color;
 
 uniform sampler2D tex;
-uniform vec3 tint;
 
 void main()
 {
@@ -12,5 +13,5 @@ void main()
 
     if(texCol.r < 0.1)
         discard;
-    color = tint;
+    color = f_tint;
 }
@@ -2,14 +2,23 @@
 
 layout (location = 0) in vec2 v_pos;
 layout (location = 1) in vec2 v_texCoord;
+layout (location = 2) in vec3 v_tint;
 
 out vec2 f_texCoord;
+flat out vec3 f_tint;
 
-uniform vec2 viewSize;
+// Shared by every program (CameraUniforms in graphics.hpp)
+layout (std140) uniform Camera
+{
+    mat4 proj;
+    mat4 view;
+    vec2 viewSize;
+};
 
 void main()
 {
     f_texCoord = v_texCoord;
+    f_tint = v_tint;
     gl_Position = vec4(2.0 * (v_pos.x / viewSize.x) - 1.0, 
                        1.0 - 2.0 * (v_pos.y / viewSize.y), 
                        0.0, 1.0);
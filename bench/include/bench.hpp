@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// Minimal microbenchmark harness
+//
+// A benchmark is a function which runs `iterations` operations. It's
+// called with growing iteration counts until one run takes at least the
+// minimum time, and the fastest of BENCH_REPEATS such runs is reported.
+
+static const int BENCH_REPEATS = 5;
+static const double BENCH_DEFAULT_MIN_TIME = 0.1;
+// Percent slower than the baseline before a result counts as a regression
+static const double BENCH_DEFAULT_THRESHOLD = 10.0;
+
+static const int BENCH_MAX_RESULTS = 256;
+
+struct BenchResult
+{
+    char name[64];
+    char fixture[64];
+
+    int64_t iterations = 0;
+    double nsPerOp = 0;
+    double opsPerSecond = 0;
+
+    // Bytes processed per operation, 0 if it doesn't apply
+    double bytesPerOp = 0;
+};
+
+struct BenchOptions
+{
+    // Only benchmarks whose "name/fixture" contains this run
+    const char* filter = nullptr;
+
+    // Seconds per timed run
+    double minTime = BENCH_DEFAULT_MIN_TIME;
+};
+
+typedef std::function<void(int64_t iterations)> BenchFn;
+
+// Returns false (and records nothing) if the benchmark is filtered out
+bool RunBench(const BenchOptions& options, const char* name, const char* fixture, double bytesPerOp,
+              const BenchFn& fn, BenchResult& result);
+
+void PrintResult(const BenchResult& result);
+
+// One object per line, so baselines can be diffed and read back without
+// a JSON library
+void WriteResultsJson(const char* filename, const BenchResult* results, int count);
+
+// Reads a file written by WriteResultsJson. Returns the number of results.
+int ReadResultsJson(const char* filename, BenchResult* results, int maxCount);
+
+// Prints every result next to its baseline and returns the number which
+// are more than threshold percent slower
+int CompareResults(const BenchResult* results, int count, const BenchResult* baseline, int baselineCount,
+                   double threshold);
+
+// Keeps results the compiler could otherwise prove unused
+void DoNotOptimize(uint64_t value);
@@ -0,0 +1,209 @@
+#include <SDL.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.hpp"
+#include "utils.hpp"
+
+static volatile uint64_t Sink;
+
+void DoNotOptimize(uint64_t value)
+{
+    Sink = Sink + value;
+}
+
+static double Time(const BenchFn& fn, int64_t iterations)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    fn(iterations);
+
+    return (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+}
+
+bool RunBench(const BenchOptions& options, const char* name, const char* fixture, double bytesPerOp,
+              const BenchFn& fn, BenchResult& result)
+{
+    char fullName[160];
+    snprintf(fullName, sizeof(fullName), "%s/%s", name, fixture);
+
+    if(options.filter && !strstr(fullName, options.filter))
+        return false;
+
+    // Warm up and find an iteration count which takes long enough
+    int64_t iterations = 1;
+    double seconds = Time(fn, iterations);
+
+    while(seconds < options.minTime && iterations < ((int64_t)1 << 40))
+    {
+        // Aim a bit past the target so this usually takes one more step
+        double scale = seconds > 0 ? options.minTime * 1.4 / seconds : 100;
+
+        if(scale > 100)
+            scale = 100;
+        else if(scale < 2)
+            scale = 2;
+
+        iterations = (int64_t)(iterations * scale);
+        seconds = Time(fn, iterations);
+    }
+
+    double best = seconds;
+
+    for(int i = 1; i < BENCH_REPEATS; ++i)
+    {
+        seconds = Time(fn, iterations);
+
+        if(seconds < best)
+            best = seconds;
+    }
+
+    result = BenchResult();
+
+    snprintf(result.name, sizeof(result.name), "%s", name);
+    snprintf(result.fixture, sizeof(result.fixture), "%s", fixture);
+
+    result.iterations = iterations;
+    result.nsPerOp = best * 1e9 / iterations;
+    result.opsPerSecond = iterations / best;
+    result.bytesPerOp = bytesPerOp;
+
+    return true;
+}
+
+void PrintResult(const BenchResult& result)
+{
+    printf("%-24s %-12s %12.1f ns/op %14.0f ops/s", result.name, result.fixture, result.nsPerOp, result.opsPerSecond);
+
+    if(result.bytesPerOp > 0)
+        printf(" %10.1f MB/s", result.bytesPerOp * result.opsPerSecond / (1024.0 * 1024.0));
+
+    printf("\n");
+}
+
+void WriteResultsJson(const char* filename, const BenchResult* results, int count)
+{
+    FILE* file = fopen(filename, "w");
+
+    if(!file)
+        CRASH("Failed to open %s for writing\n", filename);
+
+    fprintf(file, "[\n");
+
+    for(int i = 0; i < count; ++i)
+    {
+        const BenchResult& r = results[i];
+
+        fprintf(file, "  {\"name\": \"%s\", \"fixture\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f, \"bytes_per_op\": %.1f}%s\n",
+                r.name, r.fixture, (long long)r.iterations, r.nsPerOp, r.opsPerSecond, r.bytesPerOp,
+                i + 1 < count ? "," : "");
+    }
+
+    fprintf(file, "]\n");
+
+    fclose(file);
+}
+
+// Copies the string value of "key": "value" out of the line
+static bool ReadString(const char* line, const char* key, char* out, size_t size)
+{
+    const char* p = strstr(line, key);
+
+    if(!p)
+        return false;
+
+    p = strchr(p + strlen(key), '"');
+
+    if(!p)
+        return false;
+
+    const char* end = strchr(++p, '"');
+
+    if(!end || (size_t)(end - p) >= size)
+        return false;
+
+    memcpy(out, p, end - p);
+    out[end - p] = '\0';
+
+    return true;
+}
+
+static bool ReadNumber(const char* line, const char* key, double& out)
+{
+    const char* p = strstr(line, key);
+
+    return p && sscanf(p + strlen(key), " : %lf", &out) == 1;
+}
+
+int ReadResultsJson(const char* filename, BenchResult* results, int maxCount)
+{
+    FILE* file = fopen(filename, "r");
+
+    if(!file)
+        CRASH("Failed to open baseline %s\n", filename);
+
+    char line[512];
+    int count = 0;
+
+    while(count < maxCount && fgets(line, sizeof(line), file))
+    {
+        BenchResult& r = results[count];
+        r = BenchResult();
+
+        double iterations = 0;
+
+        if(!ReadString(line, "\"name\":", r.name, sizeof(r.name)) ||
+           !ReadString(line, "\"fixture\":", r.fixture, sizeof(r.fixture)) ||
+           !ReadNumber(line, "\"ns_per_op\"", r.nsPerOp))
+            continue;
+
+        ReadNumber(line, "\"iterations\"", iterations);
+        ReadNumber(line, "\"ops_per_sec\"", r.opsPerSecond);
+        ReadNumber(line, "\"bytes_per_op\"", r.bytesPerOp);
+
+        r.iterations = (int64_t)iterations;
+
+        count += 1;
+    }
+
+    fclose(file);
+
+    return count;
+}
+
+int CompareResults(const BenchResult* results, int count, const BenchResult* baseline, int baselineCount,
+                   double threshold)
+{
+    int regressions = 0;
+
+    printf("\n%-24s %-12s %12s %12s %9s\n", "benchmark", "fixture", "baseline", "current", "change");
+
+    for(int i = 0; i < count; ++i)
+    {
+        const BenchResult& r = results[i];
+        const BenchResult* base = nullptr;
+
+        for(int j = 0; j < baselineCount && !base; ++j)
+        {
+            if(strcmp(baseline[j].name, r.name) == 0 && strcmp(baseline[j].fixture, r.fixture) == 0)
+                base = &baseline[j];
+        }
+
+        if(!base || base->nsPerOp <= 0)
+        {
+            printf("%-24s %-12s %12s %12.1f %9s\n", r.name, r.fixture, "-", r.nsPerOp, "new");
+            continue;
+        }
+
+        double change = (r.nsPerOp - base->nsPerOp) / base->nsPerOp * 100.0;
+        bool regressed = change > threshold;
+
+        printf("%-24s %-12s %12.1f %12.1f %+8.1f%%%s\n", r.name, r.fixture, base->nsPerOp, r.nsPerOp, change,
+               regressed ? "  REGRESSION" : "");
+
+        if(regressed)
+            regressions += 1;
+    }
+
+    return regressions;
+}
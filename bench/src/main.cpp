@@ -0,0 +1,521 @@
+#include <SDL.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glm/glm.hpp>
+
+#include "bench.hpp"
+#include "collision.hpp"
+#include "game.hpp"
+#include "graphics.hpp"
+#include "jobs.hpp"
+#include "resources.hpp"
+#include "utils.hpp"
+#include "visibility.hpp"
+
+// Microbenchmarks for the simulation's collision queries and the level
+// and mesh loading paths. Run from the build directory (it reads the
+// levels and models copied there).
+//
+// wolf3d_bench [--filter text] [--time seconds] [--json out.json]
+//              [--baseline base.json] [--threshold percent]
+//
+// With --baseline the exit code is 1 if any benchmark got more than
+// --threshold percent slower (the count is printed).
+
+// Queries are cycled through this many precomputed inputs
+static const int BENCH_SAMPLES = 1024;
+
+// Stand-in for the level texture, only its size matters to the mesh builder
+static const int BENCH_TEXTURE_SIZE = 512;
+
+static const int SOLID_MASK = ET_MASK(ET_DOOR) | ET_MASK(ET_ENEMY) | ET_MASK(ET_PAINTING) | ET_MASK(ET_BOXCOLLIDER);
+
+struct Fixture
+{
+    const char* name;
+
+    // Text level and the same level baked and compiled by the bench
+    char mapFilename[128];
+    char lvlFilename[128];
+
+    size_t mapSize = 0;
+    size_t lvlSize = 0;
+
+    Game game;
+
+    // World space bounds of the level geometry
+    glm::vec3 min, max;
+
+    glm::vec3 positions[BENCH_SAMPLES];
+    glm::vec3 directions[BENCH_SAMPLES];
+    float angles[BENCH_SAMPLES];
+};
+
+// Separate from the game's so the inputs never depend on what ran before
+static uint32_t Rng = 0x9E3779B9;
+
+static float Random()
+{
+    Rng ^= Rng << 13;
+    Rng ^= Rng >> 17;
+    Rng ^= Rng << 5;
+
+    return (Rng >> 8) / 16777216.0f;
+}
+
+static size_t GetFileSize(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+
+    if(!file)
+        return 0;
+
+    fseek(file, 0, SEEK_END);
+    size_t size = (size_t)ftell(file);
+    fclose(file);
+
+    return size;
+}
+
+// Writes a size by size maze-ish text level: a solid border, about a
+// quarter of the inner cells solid, an enemy in every 16th open cell and
+// a box collider per solid cell, like the hand made levels
+static void GenerateMap(const char* filename, int size, uint32_t seed)
+{
+    Rng = seed;
+
+    bool* solid = new bool[size * size];
+
+    for(int z = 0; z < size; ++z)
+    {
+        for(int x = 0; x < size; ++x)
+        {
+            bool border = x == 0 || z == 0 || x == size - 1 || z == size - 1;
+            solid[z * size + x] = border || Random() < 0.25f;
+        }
+    }
+
+    // The player starts here
+    solid[1 * size + 1] = false;
+
+    auto IsSolid = [&](int x, int z) { return x < 0 || z < 0 || x >= size || z >= size || solid[z * size + x]; };
+
+    FILE* file = fopen(filename, "w");
+
+    if(!file)
+        CRASH("Failed to open %s for writing\n", filename);
+
+    int planeCount = 0;
+
+    for(int z = 0; z < size; ++z)
+    {
+        for(int x = 0; x < size; ++x)
+        {
+            if(IsSolid(x, z))
+                continue;
+
+            planeCount += 1 + IsSolid(x - 1, z) + IsSolid(x + 1, z) + IsSolid(x, z - 1) + IsSolid(x, z + 1);
+        }
+    }
+
+    fprintf(file, "%d\n", planeCount);
+
+    // Half-grid coordinates, two per cell
+    for(int z = 0; z < size; ++z)
+    {
+        for(int x = 0; x < size; ++x)
+        {
+            if(IsSolid(x, z))
+                continue;
+
+            int hx = x * 2, hz = z * 2;
+
+            fprintf(file, "%d 0 %d 0 0 -2 2 0 0 0\n", hx, hz + 2);
+
+            if(IsSolid(x - 1, z)) fprintf(file, "%d 0 %d 0 2 0 0 0 2 22\n", hx, hz);
+            if(IsSolid(x + 1, z)) fprintf(file, "%d 0 %d 0 2 0 0 0 -2 22\n", hx + 2, hz + 2);
+            if(IsSolid(x, z - 1)) fprintf(file, "%d 0 %d 0 2 0 -2 0 0 22\n", hx + 2, hz);
+            if(IsSolid(x, z + 1)) fprintf(file, "%d 0 %d 0 2 0 2 0 0 22\n", hx, hz + 2);
+        }
+    }
+
+    int enemyCount = 0;
+    int boxCount = 0;
+
+    for(int i = 0; i < size * size; ++i)
+    {
+        if(solid[i])
+            boxCount += 1;
+        else if(i % 16 == 0)
+            enemyCount += 1;
+    }
+
+    fprintf(file, "1 0 %d 0 %d\n", enemyCount, boxCount);
+
+    fprintf(file, "3 0 3\n");
+
+    for(int i = 0; i < size * size; ++i)
+    {
+        if(!solid[i] && i % 16 == 0)
+            fprintf(file, "%d 0 %d 3 2\n", (i % size) * 2 + 1, (i / size) * 2 + 1);
+    }
+
+    for(int i = 0; i < size * size; ++i)
+    {
+        if(solid[i])
+            fprintf(file, "%d.0 0 %d.0 -1.0 -1 -1.0 1.0 1 1.0\n", (i % size) * 2 + 1, (i / size) * 2 + 1);
+    }
+
+    fclose(file);
+
+    delete[] solid;
+}
+
+// Same as the cook does
+static void CompileLevel(const char* input, const char* output)
+{
+    Level level = LoadLevel(input);
+
+    BakeLevelVisibility(level);
+    RemoveHiddenPlanes(level);
+
+    SaveLevel(level, output);
+
+    DestroyLevel(level);
+}
+
+static void SetupFixture(Fixture& fixture)
+{
+    snprintf(fixture.lvlFilename, sizeof(fixture.lvlFilename), "bench_%s.lvl", fixture.name);
+
+    CompileLevel(fixture.mapFilename, fixture.lvlFilename);
+
+    fixture.mapSize = GetFileSize(fixture.mapFilename);
+    fixture.lvlSize = GetFileSize(fixture.lvlFilename);
+
+    Level level = LoadLevel(fixture.mapFilename);
+
+    // Some test levels have no player, which the game won't start without
+    if(level.entityCount[ET_PLAYER] == 0)
+    {
+        free(level.entities[ET_PLAYER]);
+
+        level.entityCount[ET_PLAYER] = 1;
+        level.entities[ET_PLAYER] = (EntityInfo*)calloc(1, sizeof(EntityInfo));
+        level.entities[ET_PLAYER][0].type = ET_PLAYER;
+    }
+
+    fixture.min = glm::vec3(INFINITY);
+    fixture.max = glm::vec3(-INFINITY);
+
+    for(int i = 0; i < level.planeCount; ++i)
+    {
+        const Level::Plane& plane = level.planes[i];
+        glm::vec3 o(plane.o[0], plane.o[1], plane.o[2]);
+
+        fixture.min = glm::min(fixture.min, o);
+        fixture.max = glm::max(fixture.max, o);
+    }
+
+    InitState(fixture.game, level);
+
+    Rng = 1;
+
+    for(int i = 0; i < BENCH_SAMPLES; ++i)
+    {
+        glm::vec3 t(Random(), 0, Random());
+
+        fixture.positions[i] = fixture.min + (fixture.max - fixture.min) * t;
+        fixture.positions[i].y = 0;
+
+        fixture.angles[i] = Random() * 2 * (float)M_PI;
+        fixture.directions[i] = glm::vec3(sinf(fixture.angles[i]), 0, cosf(fixture.angles[i]));
+    }
+}
+
+static BenchResult Results[BENCH_MAX_RESULTS];
+static int ResultCount = 0;
+
+static void Bench(const BenchOptions& options, const char* name, const char* fixture, double bytesPerOp, const BenchFn& fn)
+{
+    if(ResultCount >= BENCH_MAX_RESULTS)
+        CRASH("Too many benchmarks\n");
+
+    if(RunBench(options, name, fixture, bytesPerOp, fn, Results[ResultCount]))
+        PrintResult(Results[ResultCount++]);
+}
+
+static void BenchCollision(const BenchOptions& options, Fixture& fixture)
+{
+    Game& game = fixture.game;
+    const Entity& player = game.player;
+
+    if(game.boxColliderCount > 0)
+    {
+        Bench(options, "RayBox", fixture.name, 0, [&](int64_t iterations)
+        {
+            uint64_t hits = 0;
+            int box = 0;
+
+            for(int64_t i = 0; i < iterations; ++i)
+            {
+                const Entity& b = game.boxColliders[box];
+                int s = (int)(i & (BENCH_SAMPLES - 1));
+                float t;
+
+                hits += RayBox(fixture.positions[s], fixture.directions[s], Pos(b), b.min, b.max, &t);
+
+                if(++box == game.boxColliderCount)
+                    box = 0;
+            }
+
+            DoNotOptimize(hits);
+        });
+
+        Bench(options, "Collide", fixture.name, 0, [&](int64_t iterations)
+        {
+            uint64_t hits = 0;
+            int box = 0;
+
+            for(int64_t i = 0; i < iterations; ++i)
+            {
+                const glm::vec3& p = fixture.positions[i & (BENCH_SAMPLES - 1)];
+
+                hits += Collide(player, p.x, p.y, p.z, game.boxColliders[box]);
+
+                if(++box == game.boxColliderCount)
+                    box = 0;
+            }
+
+            DoNotOptimize(hits);
+        });
+    }
+
+    Bench(options, "CollideSolids", fixture.name, 0, [&](int64_t iterations)
+    {
+        uint64_t hits = 0;
+
+        for(int64_t i = 0; i < iterations; ++i)
+        {
+            const glm::vec3& p = fixture.positions[i & (BENCH_SAMPLES - 1)];
+
+            hits += CollideSolids(player, p.x, p.y, p.z, SOLID_MASK, game);
+        }
+
+        DoNotOptimize(hits);
+    });
+
+    Bench(options, "MoveBy", fixture.name, 0, [&](int64_t iterations)
+    {
+        Entity e = player;
+        uint64_t sum = 0;
+
+        for(int64_t i = 0; i < iterations; ++i)
+        {
+            int s = (int)(i & (BENCH_SAMPLES - 1));
+
+            e.x = fixture.positions[s].x;
+            e.z = fixture.positions[s].z;
+
+            // About a tick's worth of walking
+            MoveBy(e, fixture.directions[s].x * 0.1f, 0, fixture.directions[s].z * 0.1f, SOLID_MASK, game);
+
+            sum += (uint64_t)(e.x * 1000.0f) + (uint64_t)(e.z * 1000.0f);
+        }
+
+        DoNotOptimize(sum);
+    });
+
+    Bench(options, "GetHitEntity", fixture.name, 0, [&](int64_t iterations)
+    {
+        uint64_t sum = 0;
+
+        for(int64_t i = 0; i < iterations; ++i)
+        {
+            int s = (int)(i & (BENCH_SAMPLES - 1));
+            const glm::vec3& p = fixture.positions[s];
+
+            EntityType type;
+            glm::vec3 hitPos;
+
+            sum += (uintptr_t)GetHitEntity(p.x, p.y, p.z, fixture.angles[s], game, SOLID_MASK, type, hitPos);
+        }
+
+        DoNotOptimize(sum);
+    });
+}
+
+static void BenchLoading(const BenchOptions& options, Fixture& fixture)
+{
+    Bench(options, "LoadLevel(map)", fixture.name, (double)fixture.mapSize, [&](int64_t iterations)
+    {
+        for(int64_t i = 0; i < iterations; ++i)
+        {
+            Level level = LoadLevel(fixture.mapFilename);
+            DoNotOptimize(level.planeCount);
+            DestroyLevel(level);
+        }
+    });
+
+    Bench(options, "LoadLevel(lvl)", fixture.name, (double)fixture.lvlSize, [&](int64_t iterations)
+    {
+        for(int64_t i = 0; i < iterations; ++i)
+        {
+            Level level = LoadLevel(fixture.lvlFilename);
+            DoNotOptimize(level.planeCount);
+            DestroyLevel(level);
+        }
+    });
+
+    // The CPU half of CreateLevelMesh, the upload needs a GL context
+    Level level = LoadLevel(fixture.lvlFilename);
+
+    Texture texture;
+    texture.width = BENCH_TEXTURE_SIZE;
+    texture.height = BENCH_TEXTURE_SIZE;
+
+    Bench(options, "BuildLevelMeshData", fixture.name, 0, [&](int64_t iterations)
+    {
+        for(int64_t i = 0; i < iterations; ++i)
+        {
+            LevelMeshData data = BuildLevelMeshData(level, texture);
+            DoNotOptimize(data.indexCount);
+            DestroyLevelMeshData(data);
+        }
+    });
+
+    DestroyLevel(level);
+}
+
+static void BenchMeshLoading(const BenchOptions& options, const char* name, const char* filename)
+{
+    size_t size = GetFileSize(filename);
+
+    if(size == 0)
+    {
+        printf("Skipping LoadMeshData/%s (%s not found)\n", name, filename);
+        return;
+    }
+
+    // LoadMesh is this plus the upload
+    Bench(options, "LoadMeshData", name, (double)size, [&](int64_t iterations)
+    {
+        for(int64_t i = 0; i < iterations; ++i)
+        {
+            MeshData data = LoadMeshData(filename);
+            DoNotOptimize(data.indexCount);
+            DestroyMeshData(data);
+        }
+    });
+}
+
+static void BenchVecToDir(const BenchOptions& options)
+{
+    glm::vec3 vectors[BENCH_SAMPLES];
+
+    Rng = 2;
+
+    for(int i = 0; i < BENCH_SAMPLES; ++i)
+        vectors[i] = glm::vec3(Random() * 2 - 1, 0, Random() * 2 - 1);
+
+    Bench(options, "VecToDir", "-", 0, [&](int64_t iterations)
+    {
+        uint64_t sum = 0;
+
+        for(int64_t i = 0; i < iterations; ++i)
+        {
+            const glm::vec3& v = vectors[i & (BENCH_SAMPLES - 1)];
+            sum += VecToDir(v.x, v.z, (i & 1) != 0);
+        }
+
+        DoNotOptimize(sum);
+    });
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+
+    const char* jsonFilename = nullptr;
+    const char* baselineFilename = nullptr;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            options.filter = argv[++i];
+        else if(strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+            options.minTime = atof(argv[++i]);
+        else if(strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonFilename = argv[++i];
+        else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            baselineFilename = argv[++i];
+        else if(strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [--filter text] [--time seconds] [--json out.json] [--baseline base.json] [--threshold percent]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // The level mesh builder splits its chunks across the workers
+    InitJobs();
+
+    static Fixture fixtures[4];
+
+    fixtures[0].name = "test";
+    snprintf(fixtures[0].mapFilename, sizeof(fixtures[0].mapFilename), "levels/test.map");
+
+    fixtures[1].name = "test2";
+    snprintf(fixtures[1].mapFilename, sizeof(fixtures[1].mapFilename), "levels/test2.map");
+
+    fixtures[2].name = "large64";
+    snprintf(fixtures[2].mapFilename, sizeof(fixtures[2].mapFilename), "bench_large64.map");
+    GenerateMap(fixtures[2].mapFilename, 64, 64);
+
+    fixtures[3].name = "large256";
+    snprintf(fixtures[3].mapFilename, sizeof(fixtures[3].mapFilename), "bench_large256.map");
+    GenerateMap(fixtures[3].mapFilename, 256, 256);
+
+    for(Fixture& fixture : fixtures)
+        SetupFixture(fixture);
+
+    BenchVecToDir(options);
+
+    for(Fixture& fixture : fixtures)
+        BenchCollision(options, fixture);
+
+    for(Fixture& fixture : fixtures)
+        BenchLoading(options, fixture);
+
+    BenchMeshLoading(options, "door.obj", "models/door.obj");
+    BenchMeshLoading(options, "door.msh", "models/door.msh");
+    BenchMeshLoading(options, "painting.obj", "models/painting.obj");
+    BenchMeshLoading(options, "painting.msh", "models/painting.msh");
+
+    if(jsonFilename)
+        WriteResultsJson(jsonFilename, Results, ResultCount);
+
+    int regressions = 0;
+
+    if(baselineFilename)
+    {
+        static BenchResult baseline[BENCH_MAX_RESULTS];
+        int baselineCount = ReadResultsJson(baselineFilename, baseline, BENCH_MAX_RESULTS);
+
+        regressions = CompareResults(Results, ResultCount, baseline, baselineCount, threshold);
+
+        printf("\n%d regression(s) over %.1f%%\n", regressions, threshold);
+    }
+
+    for(Fixture& fixture : fixtures)
+        DestroyState(fixture.game);
+
+    DestroyJobs();
+
+    // Exit codes wrap at 256, so don't pass the count through
+    return regressions > 0 ? 1 : 0;
+}
@@ -1,14 +1,18 @@
 #pragma once
 
 // Immediate mode rendering utilities.
-// All the Draw procedures update a vertex buffer and 
-// use a predefined shader.
+// The Draw procedures append to a batch which is drawn once the shader
+// or texture changes, or on FlushDraw. Flush before drawing anything
+// with GL directly, or it may end up underneath what was buffered.
 
 struct Texture;
 struct Font;
 
 void InitDraw(float viewWidth, float viewHeight);
 
+// Sets the view size in the shared Camera block (see graphics.hpp). Also
+// reads the viewport so DrawRect outlines stay a pixel thick, so call it
+// again after the viewport changes.
 void SetViewSize(float width, float height);
 
 void SetDrawColor(float r, float g, float b);
@@ -27,6 +31,9 @@ void DrawFrame(const Texture& texture, float x, float y, float w, float h,
 
 void FillText(const Font& font, float x, float y, const char* text);
 
+// Draws whatever is buffered, call at least once at the end of the frame
+void FlushDraw();
+
 void DestroyDraw();
 
 
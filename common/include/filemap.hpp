@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+
+// Read-only view of an entire file. Pages are mapped copy-on-write,
+// so the contents may be patched in place without touching the file.
+struct MappedFile
+{
+    unsigned char* data = nullptr;
+    size_t size = 0;
+
+    // Platform handles (only used on Windows)
+    void* fileHandle = nullptr;
+    void* mapHandle = nullptr;
+};
+
+// Returns false if the file could not be opened or mapped
+bool TryMapFile(const char* filename, MappedFile& file);
+
+// Crashes if the file could not be mapped
+MappedFile MapFile(const char* filename);
+
+void UnmapFile(MappedFile& file);
+
+// Creates the directory if it doesn't exist. Returns false on failure.
+bool MakeDirectory(const char* path);
+
+// Writes the whole buffer to a temporary file and renames it into place,
+// so readers never see a partially written file. Returns false on failure.
+bool WriteFileAtomic(const char* filename, const void* data, size_t size);
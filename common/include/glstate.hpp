@@ -0,0 +1,41 @@
+#pragma once
+
+#include <gl3w.h>
+
+// Shadow copies of the GL state we change the most, so binding something
+// that's already bound doesn't reach the driver.
+//
+// Once something is tracked here it has to be changed through here, or
+// the shadow copy goes stale. Call InvalidateGLState after deleting GL
+// objects (GL silently unbinds them) or calling into code which doesn't
+// go through this.
+
+// Texture units tracked by BindTexture
+static const int GL_STATE_TEXTURE_UNITS = 8;
+
+struct GLStateStats
+{
+    // State changes requested and how many of them were no-ops
+    int calls = 0;
+    int skipped = 0;
+};
+
+void UseProgram(GLuint program);
+
+// Binds a GL_TEXTURE_2D texture to the unit
+void BindTexture(GLuint texture, int unit = 0);
+
+void BindVertexArray(GLuint vertexArray);
+void BindArrayBuffer(GLuint buffer);
+
+// Applies to GL_FRONT_AND_BACK
+void SetPolygonMode(GLenum mode);
+
+void SetDepthTest(bool enabled);
+void SetCullFace(bool enabled);
+
+// Forgets the shadow state, the next change of each is always issued
+void InvalidateGLState();
+
+GLStateStats GetGLStateStats();
+void ResetGLStateStats();
@@ -8,6 +8,7 @@
 
 struct Level;
 struct Texture;
+struct Shader;
 
 struct Vertex
 {
@@ -15,23 +16,137 @@ struct Vertex
     float u, v;
 };
 
+// Level geometry is drawn with level.vert/level.frag: quads may span
+// several tiles, so the atlas tile is repeated in the shader
+struct LevelVertex
+{
+    float x, y, z;
+    // Position across the quad in tiles
+    float s, t;
+    // Atlas rect of the tile (origin and signed size)
+    float u, v;
+    float du, dv;
+};
+
+// Meshes with at most this many vertices get 16-bit indices
+static const int MAX_SHORT_INDEX_VERTICES = 0x10000;
+
 // For rendering 3D meshes
 struct Mesh
 {
     int vertexCount = 0, indexCount = 0;
 
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, picked from the vertex count
+    GLenum indexType = GL_UNSIGNED_SHORT;
+
     Vertex* vertices = nullptr;
-    ushort* indices = nullptr;
+    void* indices = nullptr;
 
     GLuint vertexArray = 0;
     GLuint buffers[2];
 };
 
-// For rendering 2D sprites
+// Level meshes are split into chunks of this many tiles along x and z
+static const int LEVEL_CHUNK_TILES = 8;
+
+struct LevelChunk
+{
+    // Bounds in level space
+    glm::vec3 min, max;
+
+    // Level area (see visibility.hpp), -1 if it's always drawn
+    int area;
+
+    int baseVertex;
+    int indexOffset, indexCount;
+};
+
+// Level geometry, culled chunk by chunk
+struct LevelMesh
+{
+    Mesh mesh;
+
+    int chunkCount = 0;
+    LevelChunk* chunks = nullptr;
+};
+
+// CPU side of a level mesh (everything CreateLevelMesh does before the
+// upload), so it can be built and timed without a GL context
+struct LevelMeshData
+{
+    int vertexCount = 0;
+    LevelVertex* vertices = nullptr;
+
+    int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    void* indices = nullptr;
+
+    int chunkCount = 0;
+    LevelChunk* chunks = nullptr;
+};
+
+// Frustum planes as (normal, distance), with normals pointing inwards
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// std140 layout of the Camera uniform block, which every shader declares
+// and reads from CAMERA_BLOCK_BINDING
+struct CameraUniforms
+{
+    glm::mat4 proj;
+    glm::mat4 view;
+    // Size of the 2D view in xy
+    glm::vec4 viewSize;
+};
+
+// Per-instance data for billboard.vert
+struct BillboardInstance
+{
+    float x, y, z;
+    // Cell of the sprite sheet grid (row major)
+    float frame;
+};
+
+// Draws camera facing sprites from a sprite sheet, all in one instanced
+// call. The instances are streamed every draw (see stream.hpp).
+struct BillboardBatch
+{
+    GLuint vertexArray = 0;
+    // Quad vertices, quad indices
+    GLuint buffers[2];
+};
+
+// Number of textures a prop can switch between (see prop.frag)
+static const int PROP_MAX_VARIANTS = 2;
+
+// Per-instance data for prop.vert
+struct PropInstance
+{
+    glm::mat4 model;
+    // Index of the texture to use, below PROP_MAX_VARIANTS
+    float variant;
+};
+
+// Draws every placed copy of a static mesh in one instanced call. Uses
+// the mesh's own buffers, so the mesh must outlive the batch. The
+// instances are streamed every draw.
+struct PropBatch
+{
+    GLuint vertexArray = 0;
+
+    int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+};
+
+// For rendering 2D sprites. The vertices are streamed, so the quad has to
+// be updated every frame it's drawn.
 struct Quad
 { 
     GLuint vertexArray = 0;
-    GLuint vbo = 0;
+    // Of the vertices in the stream buffer
+    int first = 0;
 };
 
 // For doing shape rendering
@@ -61,16 +176,59 @@ struct SpriteRenderer
 void GetTileUV(const Texture& texture, int tile, float& u1, float& v1, float& u2, float& v2);
 
 Mesh CreateMesh(int vertexCount, const Vertex* vertices, int indexCount, const ushort* indices);
+// Narrows the indices to 16 bits if the vertex count allows it
+Mesh CreateMesh(int vertexCount, const Vertex* vertices, int indexCount, const uint* indices);
 Mesh CreatePlaneMesh(float u1 = 0, float v1 = 0, float u2 = 1, float v2 = 1);
-Mesh CreateLevelMesh(const Level& level, const Texture& texture);
+// Splits the planes into chunks (built in parallel) and merges adjacent
+// coplanar planes with the same tile into larger quads. The result has no
+// CPU-side copy of its vertices/indices.
+LevelMeshData BuildLevelMeshData(const Level& level, const Texture& texture);
+void DestroyLevelMeshData(LevelMeshData& data);
 
-// Changes the plane's uv coordinates to show a particular frame in a texture
+LevelMesh CreateLevelMesh(const Level& level, const Texture& texture);
+
+// Changes the plane's uv coordinates to show a particular frame in a texture.
+// Rewrites the vertices in place, so the plane keeps the frame until the
+// next call.
 void PlaneShowFrame(Mesh& mesh, const Texture& texture, int fw, int fh, int frame);
 
 void DestroyMesh(Mesh& mesh);
 
 void Draw(const Mesh& mesh);
 
+// Extracts the frustum planes from a projection * view (* model) matrix
+Frustum GetFrustum(const glm::mat4& viewProj);
+bool IsBoxVisible(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max);
+
+// Only draws the chunks inside the frustum of viewProj (which should
+// include the level's model transform) and, if visibleAreas is given, in
+// a visible area. Returns the number of chunks drawn.
+int Draw(const LevelMesh& levelMesh, const glm::mat4& viewProj, const bool* visibleAreas = nullptr);
+
+void DestroyLevelMesh(LevelMesh& levelMesh);
+
+BillboardBatch CreateBillboardBatch();
+
+// Expects billboard.vert to be bound with its uniforms set
+void Draw(BillboardBatch& batch, int count, const BillboardInstance* instances);
+
+void DestroyBillboardBatch(BillboardBatch& batch);
+
+PropBatch CreatePropBatch(const Mesh& mesh);
+
+// Expects prop.vert to be bound with its uniforms set
+void Draw(PropBatch& batch, int count, const PropInstance* instances);
+
+// Leaves the mesh alone
+void DestroyPropBatch(PropBatch& batch);
+
+// Upload to the shared Camera block (created on first use). Call these
+// once per frame (or when the view size changes), not per program.
+void UpdateCamera(const glm::mat4& proj, const glm::mat4& view);
+void UpdateCameraViewSize(float width, float height);
+
+void DestroyCamera();
+
 Quad CreateQuad();
 
 // Each call to this updates the vertex buffer of the quad
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+static const uint64_t HASH_SEED = 0xCBF29CE484222325ull;
+
+// 64-bit FNV-1a. Pass the previous result as the seed to hash
+// several buffers as one.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = HASH_SEED)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = seed;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
@@ -2,7 +2,23 @@
 
 #include <SDL.h>
 
+// Everything the game reads from the input devices for one update
+struct InputFrame
+{
+    Uint8 keys[SDL_NUM_SCANCODES] = {};
+
+    // Relative motion since the last frame
+    int mouseX = 0, mouseY = 0;
+    bool shoot = false;
+};
+
+// Samples the keyboard and mouse
 void UpdateInput();
+// Uses the frame instead of the devices (scripted input, no window needed)
+void UpdateInput(const InputFrame& frame);
+
+// The frame the functions below are answering from (for recording)
+const InputFrame& GetInputFrame();
 
 bool IsKeyDown(SDL_Scancode scancode);
 bool WasKeyPressed(SDL_Scancode scancode);
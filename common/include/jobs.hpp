@@ -0,0 +1,21 @@
+#pragma once
+
+#include <functional>
+
+// A fixed pool of worker threads for CPU work (file reads, decoding,
+// mesh building). Jobs must not touch GL.
+
+// threadCount <= 0 uses one worker per core (minus the calling thread)
+void InitJobs(int threadCount = 0);
+
+int GetJobThreadCount();
+
+// Queues the job and returns immediately
+void RunJob(std::function<void()> job);
+
+// Calls fn(i) for every i in [0, count) across the workers and the calling
+// thread. Returns once every call has finished.
+void ParallelFor(int count, const std::function<void(int)>& fn);
+
+// Finishes all queued jobs and joins the workers
+void DestroyJobs();
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "resources.hpp"
+#include "graphics.hpp"
+
+// Asynchronous asset loading.
+// Files are read and decoded on the job workers (see jobs.hpp). The GPU
+// upload happens on the GL thread in UpdateLoader through a pixel unpack
+// buffer, and the asset is marked loaded once the upload's fence signals.
+
+// Default number of bytes UpdateLoader is allowed to upload per call, so
+// loading assets in the middle of the game doesn't stall a frame
+static const size_t LOADER_FRAME_UPLOAD_BUDGET = 4 << 20;
+
+typedef int LoadHandle;
+
+// These must be called from the GL thread. The destination is written
+// (on the GL thread) once the asset is loaded and must stay valid until then.
+LoadHandle LoadTextureAsync(const char* filename, Texture* texture);
+LoadHandle LoadMeshAsync(const char* filename, Mesh* mesh);
+
+bool IsLoaded(LoadHandle handle);
+bool AreLoadsPending();
+
+// Uploads decoded assets and retires finished uploads.
+// At least one asset is uploaded per call regardless of the budget.
+void UpdateLoader(size_t uploadBudget = LOADER_FRAME_UPLOAD_BUDGET);
+
+// Blocks until every requested asset is loaded
+void WaitForLoads();
+
+void DestroyLoader();
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "filemap.hpp"
+
+// Asset pack files ("WPAK")
+static const uint32_t PACK_FILE_MAGIC = 0x4B415057;
+static const uint32_t PACK_FILE_VERSION = 1;
+
+// Entry data starts on this boundary so it can be handed to GL directly
+static const uint32_t PACK_DATA_ALIGNMENT = 256;
+
+// Compressed entries are split into independently compressed blocks
+static const uint32_t PACK_BLOCK_SIZE = 1 << 16;
+
+// Set on a block size if the block is stored uncompressed
+static const uint32_t PACK_BLOCK_RAW = 0x80000000u;
+
+enum PackEntryFlags : uint32_t
+{
+    PACK_ENTRY_COMPRESSED = 1 << 0
+};
+
+// Layout of a pack file:
+//
+//  PackHeader
+//  PackEntry[entryCount]       at tocOffset, sorted by name
+//  Names                       at nameOffset (NUL terminated)
+//  Entry data                  each at PackEntry::offset
+//
+// Compressed entry data is a sequence of blocks, each prefixed by a
+// uint32 holding its stored size (PACK_BLOCK_RAW if it isn't compressed).
+// Blocks use the LZ4 block format and decompress to PACK_BLOCK_SIZE bytes
+// (except the last one).
+struct PackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    uint32_t entryCount;
+    uint32_t tocOffset;
+    uint32_t nameOffset;
+    uint32_t nameSize;
+};
+
+struct PackEntry
+{
+    uint32_t nameOffset;        // Relative to PackHeader::nameOffset
+    uint32_t flags;
+
+    uint64_t offset;
+    uint64_t storedSize;
+    uint64_t size;              // Size once decompressed
+
+    uint64_t hash;              // HashBytes of the decompressed contents
+};
+
+// The contents of an asset, from the pack if one is open and has it,
+// otherwise from the loose file with the same name.
+struct AssetFile
+{
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    // Use GetAssetHash, loose files are only hashed on request
+    uint64_t hash = 0;
+    bool hashed = false;
+
+    // Decompression buffer (for compressed pack entries)
+    unsigned char* buffer = nullptr;
+
+    // Loose file mapping
+    MappedFile file;
+};
+
+// Once a pack is open, assets are looked up in it first. Returns false
+// (and leaves loose files in use) if the pack couldn't be opened.
+bool OpenPack(const char* filename);
+void ClosePack();
+
+bool TryOpenAsset(const char* name, AssetFile& asset);
+// Crashes if the asset doesn't exist
+AssetFile OpenAsset(const char* name);
+void CloseAsset(AssetFile& asset);
+
+// HashBytes of the contents. Free for pack entries (it's stored in the
+// entry), a full pass over the data the first time for loose files.
+uint64_t GetAssetHash(AssetFile& asset);
+
+// Builds a pack from the given files. Entries are compressed if that
+// saves enough space to be worth it.
+bool WritePack(const char* filename, int count, const char* const* names, const char* const* paths, bool compress);
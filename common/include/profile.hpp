@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+struct Font;
+
+// Scoped CPU profiler
+//
+// PROFILE_SCOPE("name") times the rest of the enclosing block. Every
+// thread records its scopes into its own ring buffer, so recording never
+// takes a lock. MarkProfileFrame (PROFILE_FRAME) splits the timeline into
+// frames for the overlay stats and the trace dump.
+//
+// Names must be string literals (or otherwise outlive the profiler).
+// Without PROFILE_ENABLED (the PROFILE CMake option, off by default) the
+// macros compile to nothing.
+
+// Scopes kept per thread
+static const int PROFILE_MAX_EVENTS = 1 << 15;
+static const int PROFILE_MAX_THREADS = 32;
+static const int PROFILE_MAX_DEPTH = 32;
+
+// Frame boundaries kept, which is also what a trace dump covers
+static const int PROFILE_MAX_FRAMES = 240;
+
+// The overlay averages over this many of the latest frames
+static const int PROFILE_STAT_FRAMES = 60;
+
+static const int PROFILE_MAX_STATS = 64;
+
+struct ProfileStat
+{
+    const char* name;
+
+    // Time spent in the scope per frame (summed if it runs more than once)
+    double averageMs;
+    double maxMs;
+
+    // Times the scope ran per frame
+    float calls;
+};
+
+void BeginProfile(const char* name);
+void EndProfile();
+
+// Shown in the trace, defaults to "Thread N"
+void SetProfileThreadName(const char* name);
+
+// Call once per frame on the main thread, at the start of the frame
+void MarkProfileFrame();
+
+// Per scope stats over the last PROFILE_STAT_FRAMES complete frames,
+// sorted by average time. Returns the number of stats.
+int GetProfileStats(ProfileStat* stats, int maxCount);
+
+// Writes the recorded frames as Chrome trace event JSON (load it in
+// chrome://tracing or ui.perfetto.dev)
+void WriteProfileTrace(const char* filename);
+
+// Stats table in the 2D view, through draw.hpp (the caller flushes)
+void DrawProfileOverlay(const Font& font, float x, float y);
+
+struct ProfileScope
+{
+    ProfileScope(const char* name) { BeginProfile(name); }
+    ~ProfileScope() { EndProfile(); }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILE_ENABLED
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_BEGIN(name) BeginProfile(name)
+#define PROFILE_END() EndProfile()
+#define PROFILE_THREAD(name) SetProfileThreadName(name)
+#define PROFILE_FRAME() MarkProfileFrame()
+#else
+#define PROFILE_SCOPE(name) (void)0
+#define PROFILE_BEGIN(name) (void)0
+#define PROFILE_END() (void)0
+#define PROFILE_THREAD(name) (void)0
+#define PROFILE_FRAME() (void)0
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <gl3w.h>
+#include <glm/glm.hpp>
+
+struct Mesh;
+struct Shader;
+
+// Deferred drawing. Draws are submitted in any order during the frame and
+// FlushRenderQueue sorts them by pass, program, texture and vertex array
+// before issuing them, so each of those changes as rarely as possible.
+//
+// Sort keys (most significant first):
+//
+//     pass (4) | program (12) | texture (16) | vertex array (16) | item (16)
+//
+// The GL names are truncated to fit. A collision only makes the order a
+// little worse, items are always drawn with their own state.
+
+static const int RENDER_QUEUE_MAX_ITEMS = 1 << 16;
+
+// Textures an item can bind (to units 0, 1, ...)
+static const int RENDER_ITEM_TEXTURES = 2;
+
+// Executed in this order
+enum RenderPass
+{
+    RENDER_PASS_OPAQUE,
+    // Wireframe, without depth testing
+    RENDER_PASS_DEBUG,
+    // No depth testing
+    RENDER_PASS_HUD,
+
+    RENDER_PASS_COUNT
+};
+
+struct RenderQueue;
+struct RenderItem;
+
+// Draws an item which isn't a single mesh (instanced batches, the level).
+// The item's program and textures are bound when it's called.
+typedef void (*RenderCallback)(const RenderQueue& queue, const RenderItem& item);
+
+struct RenderItem
+{
+    RenderPass pass = RENDER_PASS_OPAQUE;
+
+    const Shader* shader = nullptr;
+
+    // 0 leaves the unit alone
+    GLuint textures[RENDER_ITEM_TEXTURES] = {};
+
+    // Set as the shader's model uniform (if it has one) for mesh items
+    glm::mat4 model;
+
+    // Either a mesh or a callback
+    const Mesh* mesh = nullptr;
+
+    RenderCallback draw = nullptr;
+    const void* data = nullptr;
+    int count = 0;
+};
+
+struct RenderQueue
+{
+    // For the callbacks, set before flushing
+    glm::mat4 viewProj;
+
+    int count = 0, capacity = 0;
+
+    RenderItem* items = nullptr;
+
+    // Sort keys, the low bits are the item index
+    uint64_t* keys = nullptr;
+    uint64_t* scratch = nullptr;
+};
+
+void Submit(RenderQueue& queue, const RenderItem& item);
+
+// Sorts and draws everything submitted, then empties the queue. Leaves
+// depth testing on and polygons filled.
+void FlushRenderQueue(RenderQueue& queue);
+
+void DestroyRenderQueue(RenderQueue& queue);
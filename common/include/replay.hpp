@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "input.hpp"
+
+// Input recordings ("WREC")
+//
+// Every update's input and dt, plus the seed the game's RNG started
+// from, so replaying them reproduces the same session exactly.
+static const uint32_t REPLAY_FILE_MAGIC = 0x43455257;
+static const uint32_t REPLAY_FILE_VERSION = 1;
+
+// Layout of a recording:
+//
+//  ReplayHeader
+//  Frames until the end of the file, each:
+//      ReplayFrame
+//      uint16 scancode[keyCount]     the keys held down
+struct ReplayHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    uint32_t seed;
+    uint32_t reserved;
+};
+
+enum ReplayFrameFlags : uint8_t
+{
+    REPLAY_FRAME_SHOOT = 1 << 0
+};
+
+#pragma pack(push, 1)
+struct ReplayFrame
+{
+    float dt;
+
+    int16_t mouseX, mouseY;
+
+    uint8_t flags;
+    uint8_t keyCount;
+};
+#pragma pack(pop)
+
+struct InputRecorder
+{
+    FILE* file = nullptr;
+    int frameCount = 0;
+};
+
+struct InputReplay
+{
+    FILE* file = nullptr;
+    uint32_t seed = 0;
+    int frameCount = 0;
+};
+
+InputRecorder CreateInputRecorder(const char* filename, uint32_t seed);
+void Record(InputRecorder& recorder, const InputFrame& frame, float dt);
+void DestroyInputRecorder(InputRecorder& recorder);
+
+InputReplay OpenInputReplay(const char* filename);
+// Returns false once the recording runs out
+bool NextReplayFrame(InputReplay& replay, InputFrame& frame, float& dt);
+void CloseInputReplay(InputReplay& replay);
@@ -1,18 +1,41 @@
 #pragma once
 
 #include <gl3w.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stb_truetype.h>
 
+#include "pack.hpp"
+#include "types.hpp"
+
 #define ET_MASK(etype) (1 << (etype))
 
 static const int FONT_BITMAP_WIDTH = 512;
 static const int FONT_BITMAP_HEIGHT = 512;
 
 static const float LEVEL_SCALE_FACTOR = 2.0f;
-static const int MAX_LOAD_MESH_VERTICES = 500;
+
+// Compiled level files ("WLVL")
+static const uint32_t LEVEL_FILE_MAGIC = 0x4C564C57;
+static const uint32_t LEVEL_FILE_VERSION = 2;
+// Every table in a compiled level starts on this boundary
+static const uint32_t LEVEL_FILE_ALIGNMENT = 16;
+
+// Compiled mesh files ("WMSH")
+static const uint32_t MESH_FILE_MAGIC = 0x48534D57;
+static const uint32_t MESH_FILE_VERSION = 1;
+static const uint32_t MESH_FILE_ALIGNMENT = 16;
 
 struct Mesh;
+struct Vertex;
+
+// Decoded textures and shader binaries are cached here (relative to the working directory)
+#define CACHE_DIR "cache"
+
+// Texture cache files ("WTEX")
+static const uint32_t TEXTURE_CACHE_MAGIC = 0x58455457;
+static const uint32_t TEXTURE_CACHE_VERSION = 1;
+static const int MAX_TEXTURE_LEVELS = 16;
 
 struct Texture
 {
@@ -20,9 +43,123 @@ struct Texture
     int width = 0, height = 0;
 };
 
+// A decoded RGBA8 image along with its box filtered mip chain.
+// Level i is max(1, width >> i) by max(1, height >> i) pixels.
+struct TextureData
+{
+    int width = 0, height = 0;
+    int levelCount = 0;
+
+    unsigned char* levels[MAX_TEXTURE_LEVELS] = {0};
+
+    // Either every level lives in this allocation or in the mapped cache file
+    unsigned char* pixels = nullptr;
+    MappedFile file;
+};
+
+// Layout of a texture cache file:
+//
+//  TextureCacheHeader
+//  RGBA8 pixels for each level     at levelOffset[i]
+//
+// The cache file for an image is named after the hash of its contents,
+// so editing the source image simply misses the cache.
+struct TextureCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    uint64_t sourceHash;
+
+    int32_t width, height;
+    int32_t levelCount;
+    uint32_t levelOffset[MAX_TEXTURE_LEVELS];
+};
+
+// Uniforms whose locations are looked up once when a shader is loaded.
+// The camera matrices and view size live in the Camera block instead
+// (see UpdateCamera in graphics.hpp).
+enum UniformId
+{
+    UNIFORM_MODEL,
+    UNIFORM_TEX,
+    UNIFORM_YAW,
+    UNIFORM_FRAME_SIZE,
+    UNIFORM_COLUMNS,
+
+    UNIFORM_COUNT
+};
+
+// Binding point of the Camera uniform block in every program
+static const GLuint CAMERA_BLOCK_BINDING = 0;
+
 struct Shader
 {
     GLuint id = 0;
+
+    // Filled in by LoadShaders, -1 for the ones the program doesn't use
+    // (which glUniform* ignores)
+    GLint uniforms[UNIFORM_COUNT];
+};
+
+// Shader program binary cache files ("WPRG")
+static const uint32_t SHADER_CACHE_MAGIC = 0x47525057;
+static const uint32_t SHADER_CACHE_VERSION = 1;
+
+// Layout of a shader cache file:
+//
+//  ShaderCacheHeader
+//  Program binary (length bytes)
+//
+// The key is a hash of both sources and the GL vendor/renderer/version
+// strings, since binaries are only valid for the driver that made them.
+struct ShaderCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    uint64_t key;
+
+    GLenum format;
+    uint32_t length;
+};
+
+// Mesh data which hasn't been uploaded to the GPU yet
+struct MeshData
+{
+    int vertexCount = 0, indexCount = 0;
+
+    // sizeof(ushort) or sizeof(uint)
+    int indexSize = sizeof(ushort);
+
+    Vertex* vertices = nullptr;
+    void* indices = nullptr;
+
+    // If the mesh was loaded from a compiled file, vertices and
+    // indices point into this asset
+    AssetFile asset;
+};
+
+// Layout of a compiled mesh file:
+//
+//  MeshFileHeader
+//  Vertex[vertexCount]             at vertexOffset
+//  index[indexCount]               at indexOffset (indexSize bytes each)
+//
+// Vertices are deduplicated so the index buffer is actually shared.
+// Indices are 16-bit unless the mesh has more than MAX_SHORT_INDEX_VERTICES
+// vertices, in which case they're 32-bit.
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    int32_t vertexCount;
+    uint32_t vertexOffset;
+
+    int32_t indexCount;
+    uint32_t indexOffset;
+    uint32_t indexSize;
 };
 
 struct Font
@@ -66,6 +203,19 @@ struct EntityInfo
     };
 };
 
+// A door cell linking two areas of a level
+struct LevelPortal
+{
+    // Index into Level::entities[ET_DOOR]
+    int door;
+
+    // Area of the door's own cell
+    int area;
+
+    // Areas on either side of the door, -1 if there isn't one
+    int areas[2];
+};
+
 struct Level
 {
     struct Plane
@@ -92,16 +242,93 @@ struct Level
     // Number of entities of each type
     int entityCount[ET_COUNT] = {0};
     EntityInfo* entities[ET_COUNT] = {0};
+
+    // Baked visibility (see visibility.hpp), areaCount is 0 if the level
+    // hasn't been baked. Cell (x, z) covers world positions
+    // [x, x + 1) * LEVEL_SCALE_FACTOR along each axis.
+    int gridX = 0, gridZ = 0;
+    int gridWidth = 0, gridHeight = 0;
+
+    // Area of each cell (row major), -1 where solid
+    int16_t* cellAreas = nullptr;
+
+    int areaCount = 0;
+    // One row of LEVEL_PVS_ROW_SIZE(areaCount) bytes per area
+    uint8_t* pvs = nullptr;
+
+    int portalCount = 0;
+    LevelPortal* portals = nullptr;
+
+    // If the level was loaded from a compiled file, everything above
+    // points straight into this asset instead of being allocated
+    AssetFile asset;
 };
 
+#define LEVEL_PVS_ROW_SIZE(areaCount) (((areaCount) + 7) / 8)
+
+// Layout of a compiled level file:
+//
+//  LevelFileHeader
+//  Level::Plane[planeCount]                    at planeOffset
+//  EntityInfo[entityCount[i]] for each type    at entityOffset[i]
+//  int16_t[gridWidth * gridHeight]             at cellOffset
+//  uint8_t[areaCount * LEVEL_PVS_ROW_SIZE]     at pvsOffset
+//  LevelPortal[portalCount]                    at portalOffset
+//
+// All offsets are from the start of the file and aligned to
+// LEVEL_FILE_ALIGNMENT. Records are stored exactly as they are in memory.
+struct LevelFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+
+    int32_t planeCount;
+    uint32_t planeOffset;
+
+    int32_t entityCount[ET_COUNT];
+    uint32_t entityOffset[ET_COUNT];
+
+    int32_t gridX, gridZ;
+    int32_t gridWidth, gridHeight;
+    uint32_t cellOffset;
+
+    int32_t areaCount;
+    uint32_t pvsOffset;
+
+    int32_t portalCount;
+    uint32_t portalOffset;
+};
+
+// All of these resolve filenames through the open asset pack (see pack.hpp)
+// and fall back to loose files
+
+// Decodes the image (or maps it from the texture cache) and uploads every mip level
 Texture LoadTexture(const char* filename);
+
+TextureData LoadTextureData(const char* filename);
+Texture CreateTexture(const TextureData& data);
+void DestroyTextureData(TextureData& data);
+// Program binaries are cached and reused when the driver accepts them
 Shader LoadShader(const char* vertexFilename, const char* fragmentFilename);
+// Issues every compile and link before waiting on any of them, so the
+// driver can build the programs in parallel
+void LoadShaders(int count, const char* const* vertexFilenames, const char* const* fragmentFilenames, Shader* shaders);
+// Loads either a wavefront mesh (.obj) or a compiled mesh (.msh)
 Mesh LoadMesh(const char* filename);
 
+MeshData LoadMeshData(const char* filename);
+Mesh CreateMesh(const MeshData& data);
+// Writes the mesh data out in the compiled format
+void SaveMeshData(const MeshData& data, const char* filename);
+void DestroyMeshData(MeshData& data);
+
 Font LoadFont(const char* filename, float height);
 void DestroyFont(Font& font);
 
 // TODO: Implement functions to destroy textures and shaders
 
+// Loads either a text level (.map) or a compiled level (.lvl)
 Level LoadLevel(const char* filename);
+// Writes the level out in the compiled format
+void SaveLevel(const Level& level, const char* filename);
 void DestroyLevel(Level& level);
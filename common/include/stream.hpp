@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <gl3w.h>
+
+// Ring buffer for vertex data that only lives for a frame (2D batches,
+// sprite quads, instance data).
+//
+// The buffer is split into STREAM_REGIONS regions. Allocations come out
+// of the current region. When a frame ends (or the region fills up) the
+// region is fenced and the next one is used, after waiting for the GPU
+// to finish reading it, which it normally has long before.
+//
+// With ARB_buffer_storage the whole buffer is persistently mapped.
+// Otherwise every allocation maps its range unsynchronised, which is safe
+// because the fences already keep us off ranges the GPU is reading.
+
+static const int STREAM_REGIONS = 3;
+static const size_t STREAM_DEFAULT_REGION_SIZE = 4 << 20;
+
+struct StreamStats
+{
+    size_t bytesLastFrame = 0;
+    size_t bytesThisFrame = 0;
+
+    // Times we had to wait for the GPU to release a region
+    int stalls = 0;
+
+    bool persistent = false;
+};
+
+// Called by CreateContext
+void InitStream(size_t regionSize = STREAM_DEFAULT_REGION_SIZE);
+
+// The buffer every allocation lives in, bind it as an array buffer
+GLuint GetStreamBuffer();
+
+// Returns where to write size bytes, which end up at offset in the stream
+// buffer (a multiple of alignment, which doesn't have to be a power of
+// two). The pointer is valid until UnmapStream and the data until the end
+// of the frame.
+void* MapStream(size_t size, size_t alignment, size_t& offset);
+void UnmapStream();
+
+// Copies the data in and returns its offset
+size_t Stream(const void* data, size_t size, size_t alignment);
+
+// Call once per frame, after the frame's last draw
+void EndStreamFrame();
+
+StreamStats GetStreamStats();
+
+// Called by DestroyContext
+void DestroyStream();
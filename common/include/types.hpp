@@ -1,3 +1,4 @@
 #pragma once
 
 using ushort = unsigned short;
+using uint = unsigned int;
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "resources.hpp"
+
+// Potentially visible sets for levels
+//
+// Open cells (the ones with a floor) are split into areas at the door
+// cells, and every door cell becomes an area of its own. The bake works
+// out which areas could see each other with every door open. The game
+// narrows that down each frame by only walking through doors which are
+// actually open.
+
+// Longest chain of portals followed when baking
+static const int LEVEL_MAX_PORTAL_CHAIN = 32;
+
+// Fills in the level's cell grid, areas, portals and PVS
+void BakeLevelVisibility(Level& level);
+
+// Needs the baked grid. Drops planes which can never be seen (solid on
+// both sides) and duplicates, and winds the rest so their front face
+// (counter-clockwise o, o + a, o + a + b) faces the open side, which
+// makes back-face culling safe. Planes between two open cells get a
+// second, flipped copy.
+void RemoveHiddenPlanes(Level& level);
+
+// Area containing the world position, -1 if it's solid, outside the grid
+// or the level has no baked visibility
+int GetLevelArea(const Level& level, float x, float z);
+
+// Area the plane's geometry belongs to, -1 if it should always be drawn
+int GetPlaneArea(const Level& level, const Level::Plane& plane);
+
+bool IsAreaPotentiallyVisible(const Level& level, int from, int to);
@@ -1,6 +1,8 @@
 #include <gl3w.h>
 
 #include "context.hpp"
+#include "graphics.hpp"
+#include "stream.hpp"
 #include "utils.hpp"
 
 inline static void ScreenToViewCoords(const Context& context, int screenX, int screenY, float& viewX, float& viewY)
@@ -60,6 +62,9 @@ Context CreateContext(const char* title, int width, int height, ContextScaleMode
 	if (gl3wInit())
 		CRASH("Failed to initialize gl3w\n");
 
+    // Everything streamed per frame (2D batches, instances) goes through here
+    InitStream();
+
     SDL_GL_SetSwapInterval(-1);
 
     Context context;
@@ -120,6 +125,9 @@ void HandleEvent(Context& context, SDL_Event& event)
 
 void DestroyContext(Context& context)
 {
+    DestroyCamera();
+    DestroyStream();
+
     SDL_GL_DeleteContext(context.glContext);
     SDL_DestroyWindow(context.window);
 }
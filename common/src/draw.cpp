@@ -1,140 +1,197 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <gl3w.h>
 
 #include "resources.hpp"
+#include "graphics.hpp"
+#include "glstate.hpp"
+#include "stream.hpp"
+#include "utils.hpp"
 
 #include "draw.hpp"
 
 static const int CIRCLE_POINTS = 30;
 
-static float ViewWidth = 640.0f;
-static float ViewHeight = 480.0f;
+// Vertices buffered before a batch has to be flushed
+static const int DRAW_MAX_VERTICES = 1 << 16;
+
+// Every primitive uses this layout, the shaders ignore what they don't need
+struct DrawVertex
+{
+    float x, y;
+    float u, v;
+    float r, g, b;
+};
+
+enum DrawBatchType
+{
+    BATCH_NONE,
+    BATCH_SHAPES,
+    BATCH_SPRITES,
+    BATCH_TEXT
+};
 
 static struct 
 {
     float r = 1.0f, g = 1.0f, b = 1.0f;
 } DrawColor;
 
+// Size of a screen pixel in view units, so outlines stay a pixel thick
+// however the view is scaled to the window
 static struct
 {
-    Shader shader;
+    float w = 1.0f, h = 1.0f;
+} PixelSize;
 
-    GLuint viewSizeLoc = 0;
-    GLuint colorLoc = 0;
-
-    GLuint vertexArray = 0;
-    GLuint vbo = 0;
-} Shape;
+static struct
+{
+    Shader shape;
+    Shader sprite;
+    Shader text;
+} Shaders;
 
+// Primitives are collected until the shader or texture changes (or the
+// buffer fills up) and then drawn in one go
 static struct
 {
-    Shader shader;
+    DrawBatchType type = BATCH_NONE;
+    GLuint texture = 0;
 
-    GLuint viewSizeLoc = 0;
-    GLuint texLoc = 0;
+    DrawVertex* vertices = nullptr;
+    int count = 0;
 
+    // Reads from the stream buffer
     GLuint vertexArray = 0;
-    GLuint vbo = 0;
-} Sprite;
+} Batch;
 
-static struct
+static void Flush()
 {
-    Shader shader;
+    if(Batch.count == 0)
+        return;
 
-    GLuint viewSizeLoc = 0;
-    GLuint texLoc = 0;
-    GLuint tintLoc = 0;
+    // Aligned to whole vertices, so the offset can be the first vertex
+    size_t offset = Stream(Batch.vertices, sizeof(DrawVertex) * Batch.count, sizeof(DrawVertex));
 
-    GLuint vertexArray = 0;
-    GLuint vbo = 0;
-} Text;
+    BindVertexArray(Batch.vertexArray);
 
-static void SetupShapeShader()
-{
-    glUseProgram(Shape.shader.id);
+    switch(Batch.type)
+    {
+        case BATCH_SHAPES:
+            UseProgram(Shaders.shape.id);
+            break;
+
+        case BATCH_SPRITES:
+            UseProgram(Shaders.sprite.id);
+            BindTexture(Batch.texture);
+            break;
+
+        default:
+            UseProgram(Shaders.text.id);
+            BindTexture(Batch.texture);
+            break;
+    }
+
+    glDrawArrays(GL_TRIANGLES, (GLint)(offset / sizeof(DrawVertex)), Batch.count);
 
-    glUniform2f(Shape.viewSizeLoc, ViewWidth, ViewHeight);
-    glUniform3f(Shape.colorLoc, DrawColor.r, DrawColor.g, DrawColor.b);
+    Batch.count = 0;
 }
 
-static void SetupSpriteShader()
+// Room for count vertices in a batch of the type and texture
+static DrawVertex* Reserve(DrawBatchType type, GLuint texture, int count)
 {
-    glUseProgram(Sprite.shader.id);
+    if(type != Batch.type || texture != Batch.texture || Batch.count + count > DRAW_MAX_VERTICES)
+        Flush();
+
+    Batch.type = type;
+    Batch.texture = texture;
+
+    DrawVertex* vertices = &Batch.vertices[Batch.count];
+    Batch.count += count;
 
-    glUniform2f(Sprite.viewSizeLoc, ViewWidth, ViewHeight);
-    glUniform1i(Sprite.texLoc, 0);
+    return vertices;
 }
 
-static void SetupTextShader()
+static void SetVertex(DrawVertex& vertex, float x, float y, float u = 0, float v = 0)
 {
-    glUseProgram(Text.shader.id);
+    vertex.x = x;
+    vertex.y = y;
+    vertex.u = u;
+    vertex.v = v;
+    vertex.r = DrawColor.r;
+    vertex.g = DrawColor.g;
+    vertex.b = DrawColor.b;
+}
+
+// Two triangles
+static void SetQuad(DrawVertex* vertices, float x0, float y0, float x1, float y1,
+                    float u0 = 0, float v0 = 0, float u1 = 0, float v1 = 0)
+{
+    SetVertex(vertices[0], x0, y0, u0, v0);
+    SetVertex(vertices[1], x1, y0, u1, v0);
+    SetVertex(vertices[2], x1, y1, u1, v1);
 
-    glUniform2f(Text.viewSizeLoc, ViewWidth, ViewHeight);
-    glUniform1i(Text.texLoc, 0);
-    glUniform3f(Text.tintLoc, DrawColor.r, DrawColor.g, DrawColor.b);
+    SetVertex(vertices[3], x1, y1, u1, v1);
+    SetVertex(vertices[4], x0, y1, u0, v1);
+    SetVertex(vertices[5], x0, y0, u0, v0);
 }
 
 void InitDraw(float viewWidth, float viewHeight)
 {
     SetViewSize(viewWidth, viewHeight);
 
-    Shape.shader = LoadShader("shaders/shape.vert", "shaders/shape.frag");
-    
-    Shape.viewSizeLoc = glGetUniformLocation(Shape.shader.id, "viewSize");
-    Shape.colorLoc = glGetUniformLocation(Shape.shader.id, "color");
-
-    glGenVertexArrays(1, &Shape.vertexArray);
-    glGenBuffers(1, &Shape.vbo);
-
-    glBindVertexArray(Shape.vertexArray);
-    glBindBuffer(GL_ARRAY_BUFFER, Shape.vbo);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, (void*)0);
-
-    Sprite.shader = LoadShader("shaders/sprite.vert", "shaders/sprite.frag");
-
-    Sprite.viewSizeLoc = glGetUniformLocation(Sprite.shader.id, "viewSize");
-    Sprite.texLoc = glGetUniformLocation(Sprite.shader.id, "tex");
+    const char* vertexFilenames[] = { "shaders/shape.vert", "shaders/sprite.vert", "shaders/text.vert" };
+    const char* fragmentFilenames[] = { "shaders/shape.frag", "shaders/sprite.frag", "shaders/text.frag" };
 
-    glGenVertexArrays(1, &Sprite.vertexArray);
-    glGenBuffers(1, &Sprite.vbo);
+    Shader shaders[COUNT_OF(vertexFilenames)];
 
-    glBindVertexArray(Sprite.vertexArray);
-    glBindBuffer(GL_ARRAY_BUFFER, Sprite.vbo); 
+    LoadShaders(COUNT_OF(shaders), vertexFilenames, fragmentFilenames, shaders);
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
+    Shaders.shape = shaders[0];
+    Shaders.sprite = shaders[1];
+    Shaders.text = shaders[2];
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (void*)(sizeof(float) * 2));
+    // The samplers always read unit 0
+    UseProgram(Shaders.sprite.id);
+    glUniform1i(Shaders.sprite.uniforms[UNIFORM_TEX], 0);
 
-    Text.shader = LoadShader("shaders/text.vert", "shaders/text.frag");
+    UseProgram(Shaders.text.id);
+    glUniform1i(Shaders.text.uniforms[UNIFORM_TEX], 0);
 
-    Text.viewSizeLoc = glGetUniformLocation(Text.shader.id, "viewSize");
-    Text.texLoc = glGetUniformLocation(Text.shader.id, "tex");
-    Text.tintLoc = glGetUniformLocation(Text.shader.id, "tint");
+    Batch.vertices = (DrawVertex*)malloc(sizeof(DrawVertex) * DRAW_MAX_VERTICES);
 
-    glGenVertexArrays(1, &Text.vertexArray);
-    glGenBuffers(1, &Text.vbo);
+    glGenVertexArrays(1, &Batch.vertexArray);
 
-    glBindVertexArray(Text.vertexArray);
-    glBindBuffer(GL_ARRAY_BUFFER, Text.vbo); 
+    BindVertexArray(Batch.vertexArray);
+    BindArrayBuffer(GetStreamBuffer());
 
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (void*)(sizeof(float) * 2));
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(DrawVertex), (void*)offsetof(DrawVertex, x));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(DrawVertex), (void*)offsetof(DrawVertex, u));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(DrawVertex), (void*)offsetof(DrawVertex, r));
 }
 
 void SetViewSize(float width, float height)
 {
-    ViewWidth = width;
-    ViewHeight = height;
+    // Whatever is buffered was laid out for the old size
+    Flush();
+
+    UpdateCameraViewSize(width, height);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    if(viewport[2] > 0 && viewport[3] > 0)
+    {
+        PixelSize.w = width / viewport[2];
+        PixelSize.h = height / viewport[3];
+    }
 }
 
 void SetDrawColor(float r, float g, float b)
@@ -153,102 +210,55 @@ void SetDrawColorNorm(float r, float g, float b, float scale)
 
 void DrawRect(float x, float y, float w, float h)
 {
-    const float data[] =
-    {
-        x, y,
-        x + w, y,
-        x + w, y + h,
-        x, y + h,
-        x, y
-    };
-
-    SetupShapeShader();
-
-    glBindBuffer(GL_ARRAY_BUFFER, Shape.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
+    // Outlined with pixel thick quads rather than lines, so it batches
+    // with the filled shapes
+    DrawVertex* vertices = Reserve(BATCH_SHAPES, 0, 24);
 
-    glBindVertexArray(Shape.vertexArray);
+    float px = PixelSize.w;
+    float py = PixelSize.h;
 
-    glDrawArrays(GL_LINE_STRIP, 0, sizeof(data) / (sizeof(float) * 2));
+    SetQuad(vertices, x, y, x + w, y + py);
+    SetQuad(vertices + 6, x, y + h - py, x + w, y + h);
+    SetQuad(vertices + 12, x, y + py, x + px, y + h - py);
+    SetQuad(vertices + 18, x + w - px, y + py, x + w, y + h - py);
 }
 
 void FillRect(float x, float y, float w, float h)
 {
-    const float data[] =
-    {
-        x, y,
-        x + w, y,
-        x + w, y + h,
-
-        x + w, y + h,
-        x, y + h,
-        x, y
-    };
-
-    SetupShapeShader();
-
-    glBindBuffer(GL_ARRAY_BUFFER, Shape.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
-
-    glBindVertexArray(Shape.vertexArray);
-
-    glDrawArrays(GL_TRIANGLES, 0, sizeof(data) / (sizeof(float) * 2));
+    SetQuad(Reserve(BATCH_SHAPES, 0, 6), x, y, x + w, y + h);
 }
 
 void FillCircle(float x, float y, float radius)
 {
-    // For each point plus centre
-    // plus one extra point at the end to close
-    // the triangle fan
-    float data[(CIRCLE_POINTS + 1) * 2 + 2] = { x, y };
+    // One triangle from the centre per point
+    DrawVertex* vertices = Reserve(BATCH_SHAPES, 0, CIRCLE_POINTS * 3);
 
     const float radsPerPoint = (float)(M_PI * 2) / CIRCLE_POINTS;
+
+    float px = x + radius;
+    float py = y;
     
-    for(int i = 0; i <= CIRCLE_POINTS; ++i)
+    for(int i = 1; i <= CIRCLE_POINTS; ++i)
     {
-        float xx = cosf(i * radsPerPoint) * radius;
-        float yy = sinf(i * radsPerPoint) * radius;
-
-        data[2 + i * 2] = x + xx;
-        data[2 + i * 2 + 1] = y + yy;
-    }
-
-    SetupShapeShader();
+        float xx = x + cosf(i * radsPerPoint) * radius;
+        float yy = y + sinf(i * radsPerPoint) * radius;
 
-    glBindBuffer(GL_ARRAY_BUFFER, Shape.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
+        SetVertex(vertices[0], x, y);
+        SetVertex(vertices[1], px, py);
+        SetVertex(vertices[2], xx, yy);
 
-    glBindVertexArray(Shape.vertexArray);
+        vertices += 3;
 
-    glDrawArrays(GL_TRIANGLE_FAN, 0, sizeof(data) / (sizeof(float) * 2));
+        px = xx;
+        py = yy;
+    }
 }
 
 void DrawQuad(const Texture& texture,
               float x, float y, float w, float h,
               float u1, float v1, float u2, float v2)
 {
-    const float data[] =
-    {
-        x, y,                  u1, v1,
-        x + w, y,              u2, v1,
-        x + w, y + h,          u2, v2,
-
-        x + w, y + h,          u2, v2,
-        x, y + h,              u1, v2,
-        x, y,                  u1, v1
-    };
-    
-    SetupSpriteShader();
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture.id);
-
-    glBindBuffer(GL_ARRAY_BUFFER, Sprite.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
-
-    glBindVertexArray(Sprite.vertexArray);
-
-    glDrawArrays(GL_TRIANGLES, 0, sizeof(data) / (sizeof(float) * 4));
+    SetQuad(Reserve(BATCH_SPRITES, texture.id, 6), x, y, x + w, y + h, u1, v1, u2, v2);
 }
 
 void DrawFrame(const Texture& texture,
@@ -277,9 +287,6 @@ void FillText(const Font& font, float x, float y, const char* text)
 	
 	float scale = stbtt_ScaleForPixelHeight(&font.info, font.height);
 
-    auto dataSize = sizeof(float) * 4 * 6 * len;
-    auto data = (float*)malloc(dataSize);
-
 	for (size_t i = 0; i < len; ++i)
 	{
 		if (text[i] == '\n')
@@ -289,46 +296,30 @@ void FillText(const Font& font, float x, float y, const char* text)
 			continue;
 		}
 
-		float y0 = font.glyphs[text[i]].y0;
 		float actualY = y + ascent * scale;
 
 		stbtt_aligned_quad quad;
 		stbtt_GetBakedQuad(font.glyphs, FONT_BITMAP_WIDTH, FONT_BITMAP_HEIGHT, text[i], &x, &actualY, &quad, 1);
 
-		const float quadData[] = {
-			quad.x0, quad.y0, quad.s0, quad.t0,
-			quad.x1, quad.y0, quad.s1, quad.t0,
-			quad.x1, quad.y1, quad.s1, quad.t1,
-
-			quad.x1, quad.y1, quad.s1, quad.t1,
-			quad.x0, quad.y1, quad.s0, quad.t1,
-			quad.x0, quad.y0, quad.s0, quad.t0
-		};
-
-        memcpy(&data[4 * 6 * i], quadData, sizeof(float) * 4 * 6);
+        SetQuad(Reserve(BATCH_TEXT, font.texture.id, 6), quad.x0, quad.y0, quad.x1, quad.y1, 
+                quad.s0, quad.t0, quad.s1, quad.t1);
     }
+}
 
-    SetupTextShader();
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, font.texture.id);
-
-    glBindBuffer(GL_ARRAY_BUFFER, Text.vbo);
-    glBufferData(GL_ARRAY_BUFFER, dataSize, data, GL_DYNAMIC_DRAW);
-
-    glBindVertexArray(Text.vertexArray);
-
-    glDrawArrays(GL_TRIANGLES, 0, dataSize / (sizeof(float) * 4));	
+void FlushDraw()
+{
+    Flush();
 }
 
 void DestroyDraw()
 {
-	glDeleteVertexArrays(1, &Shape.vertexArray);
-	glDeleteBuffers(1, &Shape.vbo);
+    free(Batch.vertices);
+
+	glDeleteVertexArrays(1, &Batch.vertexArray);
 
-	glDeleteVertexArrays(1, &Sprite.vertexArray);
-	glDeleteBuffers(1, &Sprite.vbo);
+    Batch.vertices = nullptr;
+    Batch.count = 0;
+    Batch.vertexArray = 0;
 
-    glDeleteVertexArrays(1, &Text.vertexArray);
-    glDeleteBuffers(1, &Text.vbo);
+    InvalidateGLState();
 }
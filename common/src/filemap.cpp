@@ -0,0 +1,158 @@
+#include <atomic>
+#include <errno.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "filemap.hpp"
+#include "utils.hpp"
+
+bool TryMapFile(const char* filename, MappedFile& file)
+{
+    file = MappedFile();
+
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if(fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+
+    if(!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    HANDLE mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+    if(!mapHandle)
+    {
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapHandle, FILE_MAP_COPY, 0, 0, 0);
+
+    if(!data)
+    {
+        CloseHandle(mapHandle);
+        CloseHandle(fileHandle);
+        return false;
+    }
+
+    file.data = (unsigned char*)data;
+    file.size = (size_t)size.QuadPart;
+    file.fileHandle = fileHandle;
+    file.mapHandle = mapHandle;
+#else
+    int fd = open(filename, O_RDONLY);
+
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+
+    if(data == MAP_FAILED)
+        return false;
+
+    file.data = (unsigned char*)data;
+    file.size = (size_t)st.st_size;
+#endif
+
+    return true;
+}
+
+MappedFile MapFile(const char* filename)
+{
+    MappedFile file;
+
+    if(!TryMapFile(filename, file))
+        CRASH("Failed to map file '%s'\n", filename);
+
+    return file;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if(!file.data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mapHandle);
+    CloseHandle((HANDLE)file.fileHandle);
+#else
+    munmap(file.data, file.size);
+#endif
+
+    file = MappedFile();
+}
+
+bool MakeDirectory(const char* path)
+{
+#ifdef _WIN32
+    int result = _mkdir(path);
+#else
+    int result = mkdir(path, 0755);
+#endif
+
+    return result == 0 || errno == EEXIST;
+}
+
+bool WriteFileAtomic(const char* filename, const void* data, size_t size)
+{
+    char tempName[1024];
+
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = (int)getpid();
+#endif
+
+    // Unique per process and per call so concurrent writers don't collide
+    static std::atomic<int> counter(0);
+    snprintf(tempName, sizeof(tempName), "%s.%d.%d.tmp", filename, pid, counter++);
+
+    FILE* file = fopen(tempName, "wb");
+
+    if(!file)
+        return false;
+
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+
+#ifdef _WIN32
+    // rename doesn't replace existing files on Windows
+    if(ok) ok = MoveFileExA(tempName, filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    if(ok) ok = rename(tempName, filename) == 0;
+#endif
+
+    if(!ok)
+        remove(tempName);
+
+    return ok;
+}
@@ -0,0 +1,140 @@
+#include "glstate.hpp"
+
+// Not a valid name/mode for anything we track
+static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+static struct
+{
+    GLuint program = UNKNOWN;
+
+    GLuint activeUnit = UNKNOWN;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+
+    GLuint vertexArray = UNKNOWN;
+    GLuint arrayBuffer = UNKNOWN;
+
+    GLuint polygonMode = UNKNOWN;
+
+    // 0 = disabled, 1 = enabled
+    GLuint depthTest = UNKNOWN;
+    GLuint cullFace = UNKNOWN;
+
+    bool initialized = false;
+
+    GLStateStats stats;
+} State;
+
+// Returns false (and counts it) if the shadow already holds the value
+static bool Change(GLuint& shadow, GLuint value)
+{
+    if(!State.initialized)
+        InvalidateGLState();
+
+    State.stats.calls += 1;
+
+    if(shadow == value)
+    {
+        State.stats.skipped += 1;
+        return false;
+    }
+
+    shadow = value;
+    return true;
+}
+
+static void SetCapability(GLuint& shadow, GLenum cap, bool enabled)
+{
+    if(!Change(shadow, enabled ? 1 : 0))
+        return;
+
+    if(enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+void UseProgram(GLuint program)
+{
+    if(Change(State.program, program))
+        glUseProgram(program);
+}
+
+void BindTexture(GLuint texture, int unit)
+{
+    if(unit < 0 || unit >= GL_STATE_TEXTURE_UNITS)
+    {
+        // Not tracked
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        State.activeUnit = UNKNOWN;
+        return;
+    }
+
+    if(!Change(State.textures[unit], texture))
+        return;
+
+    // Only switch units when something actually gets bound
+    if(State.activeUnit != (GLuint)unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        State.activeUnit = unit;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void BindVertexArray(GLuint vertexArray)
+{
+    if(Change(State.vertexArray, vertexArray))
+        glBindVertexArray(vertexArray);
+}
+
+void BindArrayBuffer(GLuint buffer)
+{
+    if(Change(State.arrayBuffer, buffer))
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+}
+
+void SetPolygonMode(GLenum mode)
+{
+    if(Change(State.polygonMode, mode))
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void SetDepthTest(bool enabled)
+{
+    SetCapability(State.depthTest, GL_DEPTH_TEST, enabled);
+}
+
+void SetCullFace(bool enabled)
+{
+    SetCapability(State.cullFace, GL_CULL_FACE, enabled);
+}
+
+void InvalidateGLState()
+{
+    State.program = UNKNOWN;
+    State.activeUnit = UNKNOWN;
+
+    for(int i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+        State.textures[i] = UNKNOWN;
+
+    State.vertexArray = UNKNOWN;
+    State.arrayBuffer = UNKNOWN;
+    State.polygonMode = UNKNOWN;
+    State.depthTest = UNKNOWN;
+    State.cullFace = UNKNOWN;
+
+    State.initialized = true;
+}
+
+GLStateStats GetGLStateStats()
+{
+    return State.stats;
+}
+
+void ResetGLStateStats()
+{
+    State.stats = GLStateStats();
+}
@@ -1,9 +1,15 @@
 #include <gl3w.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 
 #include "utils.hpp"
+#include "jobs.hpp"
 #include "resources.hpp"
 #include "graphics.hpp"
+#include "glstate.hpp"
+#include "stream.hpp"
+#include "visibility.hpp"
 
 static const ushort PLANE_INDICES[] =
 {
@@ -13,6 +19,12 @@ static const ushort PLANE_INDICES[] =
     2, 3, 0
 };
 
+// Buffer behind the Camera uniform block
+static struct
+{
+    GLuint buffer = 0;
+} Camera;
+
 static const int TILE_WIDTH = 64;
 static const int TILE_HEIGHT = 64;
 
@@ -30,29 +42,54 @@ void GetTileUV(const Texture& texture, int tile, float& u1, float& v1, float& u2
     v2 = v1 - h;
 }
 
-Mesh CreateMesh(int vertexCount, const Vertex* vertices, int indexCount, const ushort* indices)
+static ushort* NarrowIndices(int indexCount, const uint* indices)
 {
-    Mesh mesh;
-    
-    mesh.vertexCount = vertexCount;
-    mesh.indexCount = indexCount;
+    ushort* narrow = (ushort*)malloc(sizeof(ushort) * indexCount);
 
-    mesh.vertices = (Vertex*)malloc(sizeof(Vertex) * vertexCount);
-    mesh.indices = (ushort*)malloc(sizeof(ushort) * indexCount);
+    for(int i = 0; i < indexCount; ++i)
+        narrow[i] = (ushort)indices[i];
 
-    memcpy(mesh.vertices, vertices, sizeof(Vertex) * vertexCount);
-    memcpy(mesh.indices, indices, sizeof(ushort) * indexCount);
+    return narrow;
+}
 
+static size_t GetIndexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_INT ? sizeof(uint) : sizeof(ushort);
+}
+
+// Creates the vertex array and buffers, leaving the vertex array bound
+// so the caller can set up its attributes
+static void UploadMesh(Mesh& mesh, size_t vertexSize, const void* vertices, const void* indices)
+{
     glGenVertexArrays(1, &mesh.vertexArray);
-    glBindVertexArray(mesh.vertexArray);
+    BindVertexArray(mesh.vertexArray);
 
     glGenBuffers(2, mesh.buffers);
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[0]);
+    BindArrayBuffer(mesh.buffers[0]);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.buffers[1]);
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertexCount, vertices, GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(ushort) * indexCount, indices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertexSize * mesh.vertexCount, vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, GetIndexSize(mesh.indexType) * mesh.indexCount, indices, GL_STATIC_DRAW);
+}
+
+static Mesh CreateMesh(int vertexCount, const Vertex* vertices, int indexCount, const void* indices, GLenum indexType)
+{
+    Mesh mesh;
+    
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount = indexCount;
+    mesh.indexType = indexType;
+
+    size_t indexSize = GetIndexSize(indexType);
+
+    mesh.vertices = (Vertex*)malloc(sizeof(Vertex) * vertexCount);
+    mesh.indices = malloc(indexSize * indexCount);
+
+    memcpy(mesh.vertices, vertices, sizeof(Vertex) * vertexCount);
+    memcpy(mesh.indices, indices, indexSize * indexCount);
+
+    UploadMesh(mesh, sizeof(Vertex), vertices, indices);
 
 	glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
@@ -63,6 +100,25 @@ Mesh CreateMesh(int vertexCount, const Vertex* vertices, int indexCount, const u
     return mesh;
 }
 
+Mesh CreateMesh(int vertexCount, const Vertex* vertices, int indexCount, const ushort* indices)
+{
+    return CreateMesh(vertexCount, vertices, indexCount, indices, GL_UNSIGNED_SHORT);
+}
+
+Mesh CreateMesh(int vertexCount, const Vertex* vertices, int indexCount, const uint* indices)
+{
+    if(vertexCount > MAX_SHORT_INDEX_VERTICES)
+        return CreateMesh(vertexCount, vertices, indexCount, indices, GL_UNSIGNED_INT);
+
+    ushort* narrow = NarrowIndices(indexCount, indices);
+
+    Mesh mesh = CreateMesh(vertexCount, vertices, indexCount, narrow, GL_UNSIGNED_SHORT);
+
+    free(narrow);
+
+    return mesh;
+}
+
 Mesh CreatePlaneMesh(float u1, float v1, float u2, float v2)
 {
     const Vertex vertices[] =
@@ -81,82 +137,510 @@ Mesh CreatePlaneMesh(float u1, float v1, float u2, float v2)
                       COUNT_OF(PLANE_INDICES), PLANE_INDICES);
 }
 
-Mesh CreateLevelMesh(const Level& level, const Texture& texture)
+// A level plane placed on the grid of its merge group
+struct LevelCell
+{
+    // Planes are built per chunk, which never spans areas
+    int area;
+    int chunkX, chunkZ;
+
+    // Planes can only merge if all of these match
+    int tile;
+    int axisA, lenA;
+    int axisB, lenB;
+    int depth;
+    int remA, remB;
+
+    // Position in units of a and b
+    int i, j;
+
+    int plane;
+};
+
+// Geometry built for one chunk, indices are relative to the chunk
+struct LevelChunkData
 {
     int vertexCount = 0;
-    Vertex* vertices = (Vertex*)malloc(sizeof(Vertex) * 4 * level.planeCount); 
-    
+    LevelVertex* vertices = nullptr;
+
     int indexCount = 0;
-	ushort* indices = (ushort*)malloc(sizeof(ushort) * 6 * level.planeCount);
+    uint* indices = nullptr;
+};
+
+static int FloorDiv(int x, int d)
+{
+    int q = x / d;
+
+    if((x % d != 0) && ((x < 0) != (d < 0)))
+        --q;
+
+    return q;
+}
+
+// Returns the axis if v only points along one, otherwise -1
+static int GetAxis(const int* v)
+{
+    int axis = -1;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        if(v[i] == 0)
+            continue;
+
+        if(axis >= 0)
+            return -1;
+
+        axis = i;
+    }
+
+    return axis;
+}
+
+static bool SameChunk(const LevelCell& x, const LevelCell& y)
+{
+    return x.area == y.area && x.chunkX == y.chunkX && x.chunkZ == y.chunkZ;
+}
+
+static bool SameGroup(const LevelCell& x, const LevelCell& y)
+{
+    return SameChunk(x, y) &&
+           x.tile == y.tile &&
+           x.axisA == y.axisA && x.lenA == y.lenA &&
+           x.axisB == y.axisB && x.lenB == y.lenB &&
+           x.depth == y.depth &&
+           x.remA == y.remA && x.remB == y.remB;
+}
+
+static bool CellLess(const LevelCell& x, const LevelCell& y)
+{
+    const int kx[] = { x.area, x.chunkX, x.chunkZ, x.tile, x.axisA, x.lenA, x.axisB, x.lenB, x.depth, x.remA, x.remB, x.j, x.i };
+    const int ky[] = { y.area, y.chunkX, y.chunkZ, y.tile, y.axisA, y.lenA, y.axisB, y.lenB, y.depth, y.remA, y.remB, y.j, y.i };
+
+    for(size_t k = 0; k < COUNT_OF(kx); ++k)
+    {
+        if(kx[k] != ky[k])
+            return kx[k] < ky[k];
+    }
+
+    return false;
+}
+
+// Emits the quad o, o + a * na, o + a * na + b * nb, o + b * nb
+static void PushLevelQuad(LevelChunkData& data, const Level::Plane& plane, int na, int nb, const Texture& texture)
+{
+    const float size = LEVEL_SCALE_FACTOR / 2.0f;
+
+    float o[3], a[3], b[3];
+
+    for(int k = 0; k < 3; ++k)
+    {
+        o[k] = plane.o[k] * size;
+        a[k] = plane.a[k] * na * size;
+        b[k] = plane.b[k] * nb * size;
+    }
+
+    float u1, v1, u2, v2;
+    GetTileUV(texture, plane.tile, u1, v1, u2, v2);
+
+    float du = u2 - u1;
+    float dv = v2 - v1;
+
+    // Texture u runs along b and v along a, same as a single plane
+    const LevelVertex verts[] =
+    {
+        { o[0], o[1], o[2], 0, 0, u1, v1, du, dv },
+        { o[0] + a[0], o[1] + a[1], o[2] + a[2], 0, (float)na, u1, v1, du, dv },
+        { o[0] + a[0] + b[0], o[1] + a[1] + b[1], o[2] + a[2] + b[2], (float)nb, (float)na, u1, v1, du, dv },
+        { o[0] + b[0], o[1] + b[1], o[2] + b[2], (float)nb, 0, u1, v1, du, dv }
+    };
+
+    uint idx = (uint)data.vertexCount;
+
+    memcpy((void*)&data.vertices[data.vertexCount], verts, sizeof(verts));
+    data.vertexCount += COUNT_OF(verts);
+
+    const uint ind[] =
+    {
+        idx, idx + 1, idx + 2,
+        idx + 2, idx + 3, idx
+    };
+
+    memcpy((void*)&data.indices[data.indexCount], ind, sizeof(ind));
+    data.indexCount += COUNT_OF(ind);
+}
+
+// Greedily merges the cells of one group into rectangles
+static void MergeLevelCells(const Level& level, const LevelCell* cells, int count, const Texture& texture, LevelChunkData& data)
+{
+    int minI = cells[0].i, maxI = cells[0].i;
+    int minJ = cells[0].j, maxJ = cells[0].j;
+
+    for(int k = 1; k < count; ++k)
+    {
+        minI = std::min(minI, cells[k].i);
+        maxI = std::max(maxI, cells[k].i);
+        minJ = std::min(minJ, cells[k].j);
+        maxJ = std::max(maxJ, cells[k].j);
+    }
+
+    int w = maxI - minI + 1;
+    int h = maxJ - minJ + 1;
+
+    // Index of the cell covering each grid position, -1 if empty or already merged
+    int* grid = (int*)malloc(sizeof(int) * w * h);
+
+    for(int k = 0; k < w * h; ++k)
+        grid[k] = -1;
+
+    for(int k = 0; k < count; ++k)
+        grid[(cells[k].j - minJ) * w + (cells[k].i - minI)] = k;
+
+    for(int y = 0; y < h; ++y)
+    {
+        for(int x = 0; x < w; ++x)
+        {
+            int start = grid[y * w + x];
+
+            if(start < 0)
+                continue;
+
+            int na = 1;
+
+            while(x + na < w && grid[y * w + x + na] >= 0)
+                ++na;
+
+            int nb = 1;
+
+            while(y + nb < h)
+            {
+                bool full = true;
+
+                for(int k = 0; k < na; ++k)
+                {
+                    if(grid[(y + nb) * w + x + k] < 0)
+                    {
+                        full = false;
+                        break;
+                    }
+                }
+
+                if(!full)
+                    break;
+
+                ++nb;
+            }
+
+            for(int yy = 0; yy < nb; ++yy)
+            {
+                for(int xx = 0; xx < na; ++xx)
+                    grid[(y + yy) * w + x + xx] = -1;
+            }
+
+            PushLevelQuad(data, level.planes[cells[start].plane], na, nb, texture);
+        }
+    }
+
+    free(grid);
+}
+
+static void BuildLevelChunk(const Level& level, const LevelCell* cells, int count, const Texture& texture,
+                            LevelChunkData& data, LevelChunk& chunk)
+{
+    data.vertices = (LevelVertex*)malloc(sizeof(LevelVertex) * 4 * count);
+    data.indices = (uint*)malloc(sizeof(uint) * 6 * count);
+
+    for(int start = 0; start < count; )
+    {
+        int end = start + 1;
+
+        while(end < count && SameGroup(cells[start], cells[end]))
+            ++end;
+
+        // Planes that aren't axis aligned rectangles are kept as they are
+        if(cells[start].axisA < 0)
+        {
+            for(int k = start; k < end; ++k)
+                PushLevelQuad(data, level.planes[cells[k].plane], 1, 1, texture);
+        }
+        else
+            MergeLevelCells(level, &cells[start], end - start, texture, data);
+
+        start = end;
+    }
+
+    chunk.min = glm::vec3(data.vertices[0].x, data.vertices[0].y, data.vertices[0].z);
+    chunk.max = chunk.min;
+
+    for(int k = 1; k < data.vertexCount; ++k)
+    {
+        glm::vec3 p(data.vertices[k].x, data.vertices[k].y, data.vertices[k].z);
+
+        chunk.min = glm::min(chunk.min, p);
+        chunk.max = glm::max(chunk.max, p);
+    }
+}
+
+LevelMeshData BuildLevelMeshData(const Level& level, const Texture& texture)
+{
+    LevelMeshData mesh;
+
+    if(level.planeCount == 0)
+        return mesh;
+
+    LevelCell* cells = (LevelCell*)malloc(sizeof(LevelCell) * level.planeCount);
+
+    // Chunk edge length in half-grid units
+    const int chunkSize = LEVEL_CHUNK_TILES * 2;
 
     for(int i = 0; i < level.planeCount; ++i)
     {
         const Level::Plane& plane = level.planes[i];
 
-        int a[3] = { plane.o[0] + plane.a[0],
-                     plane.o[1] + plane.a[1],
-                     plane.o[2] + plane.a[2] };
+        LevelCell& cell = cells[i];
+        memset(&cell, 0, sizeof(cell));
 
-        int b[3] = { plane.o[0] + plane.b[0],
-                     plane.o[1] + plane.b[1],
-                     plane.o[2] + plane.b[2] };
+        // Chunk by the plane's center (doubled to stay on integers)
+        cell.chunkX = FloorDiv(plane.o[0] * 2 + plane.a[0] + plane.b[0], chunkSize * 2);
+        cell.chunkZ = FloorDiv(plane.o[2] * 2 + plane.a[2] + plane.b[2], chunkSize * 2);
 
-        int c[3] = { plane.o[0] + plane.a[0] + plane.b[0],
-                     plane.o[1] + plane.a[1] + plane.b[1],
-                     plane.o[2] + plane.a[2] + plane.b[2] };
+        cell.area = GetPlaneArea(level, plane);
+        cell.plane = i;
 
-        const float size = LEVEL_SCALE_FACTOR / 2.0f;
-    
-        float x1 = plane.o[0] * size;
-        float y1 = plane.o[1] * size;
-        float z1 = plane.o[2] * size;
-
-        float x2 = a[0] * size;
-        float y2 = a[1] * size;
-        float z2 = a[2] * size;
-        
-        float x3 = c[0] * size;
-        float y3 = c[1] * size;
-        float z3 = c[2] * size;
-        
-        float x4 = b[0] * size;
-        float y4 = b[1] * size;
-        float z4 = b[2] * size;
-
-        float u1, v1, u2, v2;
-        GetTileUV(texture, plane.tile, u1, v1, u2, v2);
-
-        const Vertex verts[] =
+        int axisA = GetAxis(plane.a);
+        int axisB = GetAxis(plane.b);
+
+        if(axisA < 0 || axisB < 0 || axisA == axisB)
         {
-            { x1, y1, z1, u1, v1 },
-            { x2, y2, z2, u1, v2 },
-            { x3, y3, z3, u2, v2 },
-            { x4, y4, z4, u2, v1 }
-        };
+            cell.axisA = -1;
+            continue;
+        }
+
+        cell.tile = plane.tile;
+        cell.axisA = axisA;
+        cell.lenA = plane.a[axisA];
+        cell.axisB = axisB;
+        cell.lenB = plane.b[axisB];
+        cell.depth = plane.o[3 - axisA - axisB];
+
+        cell.i = FloorDiv(plane.o[axisA], cell.lenA);
+        cell.j = FloorDiv(plane.o[axisB], cell.lenB);
+
+        cell.remA = plane.o[axisA] - cell.i * cell.lenA;
+        cell.remB = plane.o[axisB] - cell.j * cell.lenB;
+    }
+
+    std::sort(cells, cells + level.planeCount, CellLess);
+
+    // First cell of every chunk, plus one past the end
+    int* chunkStart = (int*)malloc(sizeof(int) * (level.planeCount + 1));
+    int chunkCount = 0;
+
+    for(int i = 0; i < level.planeCount; ++i)
+    {
+        if(i == 0 || !SameChunk(cells[i - 1], cells[i]))
+            chunkStart[chunkCount++] = i;
+    }
+
+    chunkStart[chunkCount] = level.planeCount;
+
+    mesh.chunkCount = chunkCount;
+    mesh.chunks = (LevelChunk*)malloc(sizeof(LevelChunk) * chunkCount);
+
+    LevelChunkData* chunkData = new LevelChunkData[chunkCount];
+
+    ParallelFor(chunkCount, [&](int c)
+    {
+        BuildLevelChunk(level, &cells[chunkStart[c]], chunkStart[c + 1] - chunkStart[c], texture,
+                        chunkData[c], mesh.chunks[c]);
+    });
+
+    // Chunks are drawn with a base vertex, so their indices stay local and
+    // only need 32 bits if a single chunk is that big
+    int vertexCount = 0;
+    int indexCount = 0;
+    int maxChunkVertices = 0;
+
+    for(int c = 0; c < chunkCount; ++c)
+    {
+        LevelChunk& chunk = mesh.chunks[c];
+
+        chunk.area = cells[chunkStart[c]].area;
+        chunk.baseVertex = vertexCount;
+        chunk.indexOffset = indexCount;
+        chunk.indexCount = chunkData[c].indexCount;
+
+        vertexCount += chunkData[c].vertexCount;
+        indexCount += chunkData[c].indexCount;
+
+        maxChunkVertices = std::max(maxChunkVertices, chunkData[c].vertexCount);
+    }
+
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount = indexCount;
+    mesh.indexType = maxChunkVertices > MAX_SHORT_INDEX_VERTICES ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+
+    size_t indexSize = GetIndexSize(mesh.indexType);
+
+    LevelVertex* vertices = (LevelVertex*)malloc(sizeof(LevelVertex) * vertexCount);
+    unsigned char* indices = (unsigned char*)malloc(indexSize * indexCount);
 
-		ushort idx = (ushort)vertexCount;
+    mesh.vertices = vertices;
+    mesh.indices = indices;
 
-        memcpy((void*)&vertices[vertexCount], verts, sizeof(verts));
-        vertexCount += COUNT_OF(verts);
+    for(int c = 0; c < chunkCount; ++c)
+    {
+        const LevelChunk& chunk = mesh.chunks[c];
+        const LevelChunkData& data = chunkData[c];
+
+        memcpy(&vertices[chunk.baseVertex], data.vertices, sizeof(LevelVertex) * data.vertexCount);
 
-        const ushort ind[] =
+        if(mesh.indexType == GL_UNSIGNED_INT)
+            memcpy(indices + indexSize * chunk.indexOffset, data.indices, sizeof(uint) * data.indexCount);
+        else
         {
-            idx, idx + 1, idx + 2,
-            idx + 2, idx + 3, idx
-        };
+            ushort* dest = (ushort*)indices + chunk.indexOffset;
+
+            for(int k = 0; k < data.indexCount; ++k)
+                dest[k] = (ushort)data.indices[k];
+        }
 
-        memcpy((void*)&indices[indexCount], ind, sizeof(ind));
-        indexCount += COUNT_OF(ind);
+        free(data.vertices);
+        free(data.indices);
     }
-    
-    Mesh mesh = CreateMesh(vertexCount, vertices, indexCount, indices);
-    
-    free(vertices);
-    free(indices);
+
+    delete[] chunkData;
+
+    free(chunkStart);
+    free(cells);
 
     return mesh;
 }
 
+void DestroyLevelMeshData(LevelMeshData& data)
+{
+    free(data.vertices);
+    free(data.indices);
+    free(data.chunks);
+
+    data = LevelMeshData();
+}
+
+LevelMesh CreateLevelMesh(const Level& level, const Texture& texture)
+{
+    LevelMesh levelMesh;
+
+    if(level.planeCount == 0)
+        return levelMesh;
+
+    LevelMeshData data = BuildLevelMeshData(level, texture);
+
+    Mesh& mesh = levelMesh.mesh;
+
+    mesh.vertexCount = data.vertexCount;
+    mesh.indexCount = data.indexCount;
+    mesh.indexType = data.indexType;
+
+    UploadMesh(mesh, sizeof(LevelVertex), data.vertices, data.indices);
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(LevelVertex), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(LevelVertex), (void*)offsetof(LevelVertex, s));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(LevelVertex), (void*)offsetof(LevelVertex, u));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(LevelVertex), (void*)offsetof(LevelVertex, du));
+
+    // The mesh keeps the chunks
+    levelMesh.chunkCount = data.chunkCount;
+    levelMesh.chunks = data.chunks;
+    data.chunks = nullptr;
+
+    DestroyLevelMeshData(data);
+
+    return levelMesh;
+}
+
+Frustum GetFrustum(const glm::mat4& viewProj)
+{
+    // Gribb/Hartmann: each plane is the last row of the matrix plus or
+    // minus one of the others (glm is column major)
+    glm::vec4 rows[4];
+
+    for(int i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+
+    Frustum frustum;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        frustum.planes[i * 2] = rows[3] + rows[i];
+        frustum.planes[i * 2 + 1] = rows[3] - rows[i];
+    }
+
+    return frustum;
+}
+
+bool IsBoxVisible(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+{
+    for(int i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustum.planes[i];
+
+        // Corner furthest along the plane normal
+        glm::vec3 p(plane.x > 0 ? max.x : min.x,
+                    plane.y > 0 ? max.y : min.y,
+                    plane.z > 0 ? max.z : min.z);
+
+        if(plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0)
+            return false;
+    }
+
+    return true;
+}
+
+int Draw(const LevelMesh& levelMesh, const glm::mat4& viewProj, const bool* visibleAreas)
+{
+    const Mesh& mesh = levelMesh.mesh;
+
+    Frustum frustum = GetFrustum(viewProj);
+
+    size_t indexSize = GetIndexSize(mesh.indexType);
+
+    BindVertexArray(mesh.vertexArray);
+
+    int drawn = 0;
+
+    for(int i = 0; i < levelMesh.chunkCount; ++i)
+    {
+        const LevelChunk& chunk = levelMesh.chunks[i];
+
+        if(visibleAreas && chunk.area >= 0 && !visibleAreas[chunk.area])
+            continue;
+
+        if(!IsBoxVisible(frustum, chunk.min, chunk.max))
+            continue;
+
+        glDrawElementsBaseVertex(GL_TRIANGLES, chunk.indexCount, mesh.indexType,
+                                 (void*)(indexSize * chunk.indexOffset), chunk.baseVertex);
+
+        drawn += 1;
+    }
+
+    return drawn;
+}
+
+void DestroyLevelMesh(LevelMesh& levelMesh)
+{
+    if(levelMesh.mesh.vertexArray)
+        DestroyMesh(levelMesh.mesh);
+
+    free(levelMesh.chunks);
+
+    levelMesh = LevelMesh();
+}
+
 void PlaneShowFrame(Mesh& mesh, const Texture& texture, int fw, int fh, int frame)
 {
     int columns = texture.width / fw;
@@ -179,10 +663,13 @@ void PlaneShowFrame(Mesh& mesh, const Texture& texture, int fw, int fh, int fram
         { -1, -1, 0, u, v + h }
     };
     
-    // TODO: Check if this is safe to do without binding vertex array
+    if(mesh.vertices)
+        memcpy(mesh.vertices, vertices, sizeof(vertices));
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+    // The array buffer binding isn't part of the vertex array, so this
+    // doesn't need it bound. Same size, so no reallocation.
+    BindArrayBuffer(mesh.buffers[0]);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
 }
 
 void DestroyMesh(Mesh& mesh)
@@ -190,14 +677,178 @@ void DestroyMesh(Mesh& mesh)
     glDeleteVertexArrays(1, &mesh.vertexArray);
     glDeleteBuffers(2, mesh.buffers);
 
+    InvalidateGLState();
+
     free(mesh.vertices);
     free(mesh.indices);
 }
 
 void Draw(const Mesh& mesh)
 {
-    glBindVertexArray(mesh.vertexArray);
-    glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_SHORT, (void*)0);
+    BindVertexArray(mesh.vertexArray);
+    glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)0);
+}
+
+BillboardBatch CreateBillboardBatch()
+{
+    // Unit quad with 0-1 texture coordinates, billboard.vert picks the frame
+    const Vertex vertices[] =
+    {
+        { -1, 1, 0, 0, 0 },
+        { 1, 1, 0, 1, 0 },
+        { 1, -1, 0, 1, 1 },
+        { -1, -1, 0, 0, 1 }
+    };
+
+    BillboardBatch batch;
+
+    glGenVertexArrays(1, &batch.vertexArray);
+    BindVertexArray(batch.vertexArray);
+
+    glGenBuffers(2, batch.buffers);
+
+    BindArrayBuffer(batch.buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(PLANE_INDICES), PLANE_INDICES, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, u));
+
+    // Pointed at the instances in Draw
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    return batch;
+}
+
+void Draw(BillboardBatch& batch, int count, const BillboardInstance* instances)
+{
+    if(count <= 0)
+        return;
+
+    size_t offset = Stream(instances, sizeof(BillboardInstance) * count, sizeof(BillboardInstance));
+
+    BindVertexArray(batch.vertexArray);
+    BindArrayBuffer(GetStreamBuffer());
+
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)offset);
+
+    glDrawElementsInstanced(GL_TRIANGLES, COUNT_OF(PLANE_INDICES), GL_UNSIGNED_SHORT, (void*)0, count);
+}
+
+void DestroyBillboardBatch(BillboardBatch& batch)
+{
+    glDeleteVertexArrays(1, &batch.vertexArray);
+    glDeleteBuffers(2, batch.buffers);
+
+    InvalidateGLState();
+
+    batch = BillboardBatch();
+}
+
+PropBatch CreatePropBatch(const Mesh& mesh)
+{
+    PropBatch batch;
+
+    batch.indexCount = mesh.indexCount;
+    batch.indexType = mesh.indexType;
+
+    glGenVertexArrays(1, &batch.vertexArray);
+    BindVertexArray(batch.vertexArray);
+
+    BindArrayBuffer(mesh.buffers[0]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.buffers[1]);
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, u));
+
+    // The model matrix takes up one attribute per column (2-5), the
+    // variant is 6. They're pointed at the instances in Draw.
+    for(int i = 2; i <= 6; ++i)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    return batch;
+}
+
+void Draw(PropBatch& batch, int count, const PropInstance* instances)
+{
+    if(count <= 0)
+        return;
+
+    size_t offset = Stream(instances, sizeof(PropInstance) * count, sizeof(PropInstance));
+
+    BindVertexArray(batch.vertexArray);
+    BindArrayBuffer(GetStreamBuffer());
+
+    for(int i = 0; i < 4; ++i)
+    {
+        glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(PropInstance), 
+                              (void*)(offset + offsetof(PropInstance, model) + sizeof(glm::vec4) * i));
+    }
+
+    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(PropInstance), (void*)(offset + offsetof(PropInstance, variant)));
+
+    glDrawElementsInstanced(GL_TRIANGLES, batch.indexCount, batch.indexType, (void*)0, count);
+}
+
+void DestroyPropBatch(PropBatch& batch)
+{
+    glDeleteVertexArrays(1, &batch.vertexArray);
+
+    InvalidateGLState();
+
+    batch = PropBatch();
+}
+
+static void BindCameraBuffer()
+{
+    if(Camera.buffer)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, Camera.buffer);
+        return;
+    }
+
+    glGenBuffers(1, &Camera.buffer);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, Camera.buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), nullptr, GL_DYNAMIC_DRAW);
+
+    // Stays bound, so every program sees it without rebinding
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, Camera.buffer);
+}
+
+void UpdateCamera(const glm::mat4& proj, const glm::mat4& view)
+{
+    BindCameraBuffer();
+
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(CameraUniforms, proj), sizeof(proj), &proj[0][0]);
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(CameraUniforms, view), sizeof(view), &view[0][0]);
+}
+
+void UpdateCameraViewSize(float width, float height)
+{
+    glm::vec4 viewSize(width, height, 0, 0);
+
+    BindCameraBuffer();
+
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(CameraUniforms, viewSize), sizeof(viewSize), &viewSize[0]);
+}
+
+void DestroyCamera()
+{
+    glDeleteBuffers(1, &Camera.buffer);
+    Camera.buffer = 0;
 }
 
 Quad CreateQuad()
@@ -205,11 +856,10 @@ Quad CreateQuad()
     Quad quad;
 
     glGenVertexArrays(1, &quad.vertexArray);
-    glGenBuffers(1, &quad.vbo);
 
-    glBindVertexArray(quad.vertexArray);
+    BindVertexArray(quad.vertexArray);
 
-    glBindBuffer(GL_ARRAY_BUFFER, quad.vbo);
+    BindArrayBuffer(GetStreamBuffer());
 
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
@@ -250,8 +900,8 @@ void Update(Quad& quad, const Texture& texture, float x, float y, float w, float
         u1, v1
     };
 
-    glBindBuffer(GL_ARRAY_BUFFER, quad.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
+    // Whole vertices, so the offset can be the first vertex
+    quad.first = (int)(Stream(data, sizeof(data), sizeof(float) * 4) / (sizeof(float) * 4));
 }
 
 void Update(Quad& quad, const Texture& texture, float x, float y, float w, float h)
@@ -263,12 +913,13 @@ void Update(Quad& quad, const Texture& texture, float x, float y, float w, float
 
 void Draw(const Quad& quad)
 {
-    glBindVertexArray(quad.vertexArray);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    BindVertexArray(quad.vertexArray);
+    glDrawArrays(GL_TRIANGLES, quad.first, 6);
 }
 
 void DestroyQuad(Quad& quad)
 {
     glDeleteVertexArrays(1, &quad.vertexArray);
-    glDeleteBuffers(1, &quad.vbo);
+
+    InvalidateGLState();
 }
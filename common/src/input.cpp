@@ -2,34 +2,52 @@
 
 #include "input.hpp"
 
-static Uint8 PrevKeyState[SDL_NUM_SCANCODES];
-static Uint8 KeyState[SDL_NUM_SCANCODES];
+static InputFrame PrevFrame;
+static InputFrame Frame;
 
 void UpdateInput()
 {
+    InputFrame frame;
+
     int keyCount = 0;
     const Uint8* keys = SDL_GetKeyboardState(&keyCount);
 
-    memcpy((void*)PrevKeyState, (void*)KeyState, sizeof(PrevKeyState));
-    memcpy((void*)KeyState, (void*)keys, sizeof(Uint8) * keyCount);
+    memcpy((void*)frame.keys, (void*)keys, sizeof(Uint8) * keyCount);
+
+    SDL_GetRelativeMouseState(&frame.mouseX, &frame.mouseY);
+    frame.shoot = (SDL_GetMouseState(nullptr, nullptr) & SDL_BUTTON(SDL_BUTTON_LEFT)) != 0;
+
+    UpdateInput(frame);
+}
+
+void UpdateInput(const InputFrame& frame)
+{
+    PrevFrame = Frame;
+    Frame = frame;
+}
+
+const InputFrame& GetInputFrame()
+{
+    return Frame;
 }
 
 bool IsKeyDown(SDL_Scancode scancode)
 {
-    return KeyState[(int)scancode] > 0;
+    return Frame.keys[(int)scancode] > 0;
 }
 
 bool WasKeyPressed(SDL_Scancode scancode)
 {
-    return PrevKeyState[(int)scancode] == 0 && KeyState[(int)scancode] > 0;
+    return PrevFrame.keys[(int)scancode] == 0 && Frame.keys[(int)scancode] > 0;
 }
 
 void GetMouseMotion(int* x, int* y)
 {
-    SDL_GetRelativeMouseState(x, y);
+    *x = Frame.mouseX;
+    *y = Frame.mouseY;
 }
 
 bool IsShootButtonDown() 
 {
-    return SDL_GetMouseState(nullptr, nullptr) & SDL_BUTTON(SDL_BUTTON_LEFT);
+    return Frame.shoot;
 }
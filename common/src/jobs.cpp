@@ -0,0 +1,156 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "jobs.hpp"
+#include "utils.hpp"
+
+static struct
+{
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> queue;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    bool quit = false;
+} Jobs;
+
+static void WorkerMain()
+{
+    while(true)
+    {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(Jobs.mutex);
+            Jobs.wake.wait(lock, [] { return Jobs.quit || !Jobs.queue.empty(); });
+
+            if(Jobs.queue.empty())
+                return;
+
+            job = std::move(Jobs.queue.front());
+            Jobs.queue.pop_front();
+        }
+
+        job();
+    }
+}
+
+void InitJobs(int threadCount)
+{
+    if(!Jobs.threads.empty())
+        CRASH("InitJobs called twice\n");
+
+    if(threadCount <= 0)
+    {
+        threadCount = (int)std::thread::hardware_concurrency() - 1;
+
+        if(threadCount < 1)
+            threadCount = 1;
+    }
+
+    Jobs.quit = false;
+
+    for(int i = 0; i < threadCount; ++i)
+        Jobs.threads.emplace_back(WorkerMain);
+}
+
+int GetJobThreadCount()
+{
+    return (int)Jobs.threads.size();
+}
+
+void RunJob(std::function<void()> job)
+{
+    if(Jobs.threads.empty())
+    {
+        // No workers, so just do it inline
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(Jobs.mutex);
+        Jobs.queue.push_back(std::move(job));
+    }
+
+    Jobs.wake.notify_one();
+}
+
+void ParallelFor(int count, const std::function<void(int)>& fn)
+{
+    if(count <= 0)
+        return;
+
+    // Helpers may only get to run after everything is done (if the queue
+    // is busy), so they share ownership of this instead of pointing at
+    // the caller's stack
+    struct Shared
+    {
+        std::function<void(int)> fn;
+        int count = 0;
+
+        std::atomic<int> next;
+        std::atomic<int> done;
+
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    auto shared = std::make_shared<Shared>();
+
+    shared->fn = fn;
+    shared->count = count;
+    shared->next = 0;
+    shared->done = 0;
+
+    // Each participant keeps grabbing indices until they run out
+    auto work = [shared]() {
+        int finished = 0;
+
+        for(int i = shared->next++; i < shared->count; i = shared->next++)
+        {
+            shared->fn(i);
+            finished += 1;
+        }
+
+        if(finished > 0 && (shared->done += finished) == shared->count)
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->finished.notify_all();
+        }
+    };
+
+    int helpers = GetJobThreadCount();
+
+    if(helpers > count - 1)
+        helpers = count - 1;
+
+    for(int i = 0; i < helpers; ++i)
+        RunJob(work);
+
+    work();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->finished.wait(lock, [&shared] { return shared->done == shared->count; });
+}
+
+void DestroyJobs()
+{
+    {
+        std::lock_guard<std::mutex> lock(Jobs.mutex);
+        Jobs.quit = true;
+    }
+
+    Jobs.wake.notify_all();
+
+    for(auto& thread : Jobs.threads)
+        thread.join();
+
+    Jobs.threads.clear();
+}
@@ -0,0 +1,282 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "loader.hpp"
+#include "jobs.hpp"
+#include "utils.hpp"
+
+enum LoadType
+{
+    LOAD_TEXTURE,
+    LOAD_MESH
+};
+
+enum LoadState
+{
+    LOAD_QUEUED,        // Waiting for/being decoded by a worker
+    LOAD_DECODED,       // Waiting for an upload on the GL thread
+    LOAD_UPLOADING,     // Waiting for the upload fence
+    LOAD_DONE
+};
+
+struct LoadRequest
+{
+    LoadType type;
+    char filename[256];
+
+    void* dest = nullptr;
+
+    std::atomic<int> state;
+
+    TextureData textureData;
+    MeshData meshData;
+
+    Texture texture;
+
+    GLuint pbo = 0;
+    GLsync fence = 0;
+};
+
+static struct
+{
+    // Only modified on the GL thread
+    std::vector<LoadRequest*> requests;
+    int pending = 0;
+
+    std::mutex mutex;
+    std::condition_variable decoded;
+} Loader;
+
+static void Decode(LoadRequest* request)
+{
+    if(request->type == LOAD_TEXTURE)
+        request->textureData = LoadTextureData(request->filename);
+    else
+        request->meshData = LoadMeshData(request->filename);
+
+    {
+        std::lock_guard<std::mutex> lock(Loader.mutex);
+        request->state = LOAD_DECODED;
+    }
+
+    Loader.decoded.notify_all();
+}
+
+static LoadHandle Request(LoadType type, const char* filename, void* dest)
+{
+    LoadRequest* request = new LoadRequest;
+
+    request->type = type;
+    request->dest = dest;
+    request->state = LOAD_QUEUED;
+
+    if(strlen(filename) >= sizeof(request->filename))
+        CRASH("Asset filename '%s' is too long\n", filename);
+
+    strcpy(request->filename, filename);
+
+    Loader.requests.push_back(request);
+    Loader.pending += 1;
+
+    RunJob([request] { Decode(request); });
+
+    return (LoadHandle)Loader.requests.size() - 1;
+}
+
+LoadHandle LoadTextureAsync(const char* filename, Texture* texture)
+{
+    return Request(LOAD_TEXTURE, filename, texture);
+}
+
+LoadHandle LoadMeshAsync(const char* filename, Mesh* mesh)
+{
+    return Request(LOAD_MESH, filename, mesh);
+}
+
+bool IsLoaded(LoadHandle handle)
+{
+    if(handle < 0 || handle >= (int)Loader.requests.size())
+        return false;
+
+    return Loader.requests[handle]->state == LOAD_DONE;
+}
+
+bool AreLoadsPending()
+{
+    return Loader.pending > 0;
+}
+
+static size_t GetUploadSize(const LoadRequest* request)
+{
+    if(request->type == LOAD_MESH)
+        return sizeof(Vertex) * request->meshData.vertexCount + (size_t)request->meshData.indexSize * request->meshData.indexCount;
+
+    const TextureData& data = request->textureData;
+    size_t size = 0;
+
+    for(int i = 0; i < data.levelCount; ++i)
+    {
+        int w = data.width >> i;
+        int h = data.height >> i;
+
+        size += (size_t)(w > 0 ? w : 1) * (h > 0 ? h : 1) * 4;
+    }
+
+    return size;
+}
+
+static void Finish(LoadRequest* request)
+{
+    if(request->type == LOAD_TEXTURE)
+        *(Texture*)request->dest = request->texture;
+
+    request->state = LOAD_DONE;
+    Loader.pending -= 1;
+}
+
+static void StartUpload(LoadRequest* request)
+{
+    if(request->type == LOAD_MESH)
+    {
+        MeshData& data = request->meshData;
+
+        // Vertex/index buffers are small and glBufferData already copies
+        // them, so there's no need to stage these
+        *(Mesh*)request->dest = CreateMesh(data);
+
+        DestroyMeshData(data);
+        Finish(request);
+
+        return;
+    }
+
+    TextureData& data = request->textureData;
+    size_t size = GetUploadSize(request);
+
+    glGenBuffers(1, &request->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request->pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+    unsigned char* staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, 
+                                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+    if(!staging)
+        CRASH("Failed to map upload buffer for '%s'\n", request->filename);
+
+    // With the unpack buffer bound, the level "pointers" are offsets into it
+    TextureData staged = data;
+    staged.pixels = nullptr;
+    staged.file = MappedFile();
+
+    size_t offset = 0;
+
+    for(int i = 0; i < data.levelCount; ++i)
+    {
+        int w = data.width >> i;
+        int h = data.height >> i;
+        size_t levelSize = (size_t)(w > 0 ? w : 1) * (h > 0 ? h : 1) * 4;
+
+        memcpy(staging + offset, data.levels[i], levelSize);
+        staged.levels[i] = (unsigned char*)(uintptr_t)offset;
+
+        offset += levelSize;
+    }
+
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    request->texture = CreateTexture(staged);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    request->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    request->state = LOAD_UPLOADING;
+
+    DestroyTextureData(data);
+}
+
+static bool PollUpload(LoadRequest* request)
+{
+    GLenum result = glClientWaitSync(request->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+    if(result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+        return false;
+
+    glDeleteSync(request->fence);
+    glDeleteBuffers(1, &request->pbo);
+
+    request->fence = 0;
+    request->pbo = 0;
+
+    Finish(request);
+
+    return true;
+}
+
+void UpdateLoader(size_t uploadBudget)
+{
+    if(Loader.pending == 0)
+        return;
+
+    size_t uploaded = 0;
+    bool first = true;
+
+    for(LoadRequest* request : Loader.requests)
+    {
+        int state = request->state;
+
+        if(state == LOAD_DECODED)
+        {
+            size_t size = GetUploadSize(request);
+
+            if(!first && uploaded + size > uploadBudget)
+                continue;
+
+            StartUpload(request);
+
+            uploaded += size;
+            first = false;
+        }
+        else if(state == LOAD_UPLOADING)
+            PollUpload(request);
+    }
+}
+
+void WaitForLoads()
+{
+    while(Loader.pending > 0)
+    {
+        UpdateLoader(SIZE_MAX);
+
+        if(Loader.pending == 0)
+            break;
+
+        // Wake up as soon as a worker finishes decoding. Uploads in
+        // flight are polled again after a short while.
+        std::unique_lock<std::mutex> lock(Loader.mutex);
+
+        Loader.decoded.wait_for(lock, std::chrono::milliseconds(1), [] {
+            for(LoadRequest* request : Loader.requests)
+            {
+                if(request->state == LOAD_DECODED)
+                    return true;
+            }
+
+            return false;
+        });
+    }
+}
+
+void DestroyLoader()
+{
+    WaitForLoads();
+
+    for(LoadRequest* request : Loader.requests)
+        delete request;
+
+    Loader.requests.clear();
+}
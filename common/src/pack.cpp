@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "pack.hpp"
+#include "hash.hpp"
+#include "utils.hpp"
+
+// Minimum match length of the LZ4 block format
+static const int LZ_MIN_MATCH = 4;
+// The last match must start this far from the end of the block
+static const int LZ_MATCH_LIMIT = 12;
+// The last bytes of a block are always literals
+static const int LZ_LAST_LITERALS = 5;
+static const int LZ_HASH_BITS = 12;
+
+// Only keep the compressed version of an entry if it saves this fraction
+static const float PACK_MIN_SAVING = 0.1f;
+
+static struct
+{
+    MappedFile file;
+
+    const PackHeader* header = nullptr;
+    const PackEntry* entries = nullptr;
+    const char* names = nullptr;
+} Pack;
+
+inline static uint32_t Read32(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline static uint32_t HashSequence(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void WriteLength(std::vector<unsigned char>& out, int length)
+{
+    while(length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+
+    out.push_back((unsigned char)length);
+}
+
+static void WriteSequence(std::vector<unsigned char>& out, const unsigned char* literals, int literalLength, int offset, int matchLength)
+{
+    unsigned char token = (unsigned char)((literalLength >= 15 ? 15 : literalLength) << 4);
+
+    if(matchLength > 0)
+        token |= (unsigned char)(matchLength - LZ_MIN_MATCH >= 15 ? 15 : matchLength - LZ_MIN_MATCH);
+
+    out.push_back(token);
+
+    if(literalLength >= 15)
+        WriteLength(out, literalLength - 15);
+
+    out.insert(out.end(), literals, literals + literalLength);
+
+    if(matchLength > 0)
+    {
+        out.push_back((unsigned char)(offset & 0xFF));
+        out.push_back((unsigned char)(offset >> 8));
+
+        if(matchLength - LZ_MIN_MATCH >= 15)
+            WriteLength(out, matchLength - LZ_MIN_MATCH - 15);
+    }
+}
+
+// Greedy LZ4 block compression
+static void CompressBlock(const unsigned char* src, int size, std::vector<unsigned char>& out)
+{
+    int table[1 << LZ_HASH_BITS];
+
+    for(int i = 0; i < (1 << LZ_HASH_BITS); ++i)
+        table[i] = -1;
+
+    int anchor = 0;
+    int pos = 0;
+
+    while(pos + LZ_MATCH_LIMIT <= size)
+    {
+        uint32_t sequence = Read32(src + pos);
+        uint32_t h = HashSequence(sequence);
+
+        int candidate = table[h];
+        table[h] = pos;
+
+        if(candidate < 0 || pos - candidate > 0xFFFF || Read32(src + candidate) != sequence)
+        {
+            pos += 1;
+            continue;
+        }
+
+        int matchLength = LZ_MIN_MATCH;
+        int maxLength = size - LZ_LAST_LITERALS - pos;
+
+        while(matchLength < maxLength && src[candidate + matchLength] == src[pos + matchLength])
+            matchLength += 1;
+
+        WriteSequence(out, src + anchor, pos - anchor, pos - candidate, matchLength);
+
+        pos += matchLength;
+        anchor = pos;
+    }
+
+    WriteSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+static bool ReadLength(const unsigned char*& p, const unsigned char* end, int& length)
+{
+    unsigned char b;
+
+    do
+    {
+        if(p >= end)
+            return false;
+
+        b = *p++;
+        length += b;
+    } while(b == 255);
+
+    return true;
+}
+
+static bool DecompressBlock(const unsigned char* src, int size, unsigned char* dst, int dstSize)
+{
+    const unsigned char* p = src;
+    const unsigned char* end = src + size;
+
+    int out = 0;
+
+    while(p < end)
+    {
+        unsigned char token = *p++;
+
+        int literalLength = token >> 4;
+
+        if(literalLength == 15 && !ReadLength(p, end, literalLength))
+            return false;
+
+        if(literalLength > end - p || literalLength > dstSize - out)
+            return false;
+
+        memcpy(dst + out, p, literalLength);
+        p += literalLength;
+        out += literalLength;
+
+        // The last sequence has no match
+        if(p >= end)
+            break;
+
+        if(end - p < 2)
+            return false;
+
+        int offset = p[0] | (p[1] << 8);
+        p += 2;
+
+        int matchLength = token & 15;
+
+        if(matchLength == 15 && !ReadLength(p, end, matchLength))
+            return false;
+
+        matchLength += LZ_MIN_MATCH;
+
+        if(offset == 0 || offset > out || matchLength > dstSize - out)
+            return false;
+
+        // Byte by byte since the match may overlap the output
+        for(int i = 0; i < matchLength; ++i)
+            dst[out + i] = dst[out - offset + i];
+
+        out += matchLength;
+    }
+
+    return out == dstSize;
+}
+
+bool OpenPack(const char* filename)
+{
+    ClosePack();
+
+    MappedFile file;
+
+    if(!TryMapFile(filename, file))
+        return false;
+
+    const PackHeader* header = (const PackHeader*)file.data;
+
+    if(file.size < sizeof(PackHeader) || header->magic != PACK_FILE_MAGIC)
+    {
+        fprintf(stderr, "'%s' is not an asset pack\n", filename);
+        UnmapFile(file);
+        return false;
+    }
+
+    if(header->version != PACK_FILE_VERSION)
+    {
+        fprintf(stderr, "Asset pack '%s' has version %u (expected %u)\n", filename, header->version, PACK_FILE_VERSION);
+        UnmapFile(file);
+        return false;
+    }
+
+    if(header->tocOffset + (size_t)header->entryCount * sizeof(PackEntry) > file.size ||
+       header->nameOffset + (size_t)header->nameSize > file.size)
+    {
+        fprintf(stderr, "Asset pack '%s' is truncated\n", filename);
+        UnmapFile(file);
+        return false;
+    }
+
+    Pack.file = file;
+    Pack.header = header;
+    Pack.entries = (const PackEntry*)(file.data + header->tocOffset);
+    Pack.names = (const char*)(file.data + header->nameOffset);
+
+    return true;
+}
+
+void ClosePack()
+{
+    UnmapFile(Pack.file);
+
+    Pack.header = nullptr;
+    Pack.entries = nullptr;
+    Pack.names = nullptr;
+}
+
+static const PackEntry* FindEntry(const char* name)
+{
+    if(!Pack.header)
+        return nullptr;
+
+    // Names are sorted, so binary search
+    int lo = 0;
+    int hi = (int)Pack.header->entryCount - 1;
+
+    while(lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(name, Pack.names + Pack.entries[mid].nameOffset);
+
+        if(cmp == 0)
+            return &Pack.entries[mid];
+
+        if(cmp < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+
+    return nullptr;
+}
+
+static bool ReadEntry(const PackEntry& entry, AssetFile& asset)
+{
+    const unsigned char* stored = Pack.file.data + entry.offset;
+
+    if(entry.offset + entry.storedSize > Pack.file.size)
+        return false;
+
+    asset.size = (size_t)entry.size;
+    asset.hash = entry.hash;
+    asset.hashed = true;
+
+    if(!(entry.flags & PACK_ENTRY_COMPRESSED))
+    {
+        asset.data = stored;
+        return true;
+    }
+
+    asset.buffer = (unsigned char*)malloc(asset.size ? asset.size : 1);
+
+    if(!asset.buffer)
+        CRASH("Out of memory\n");
+
+    const unsigned char* p = stored;
+    const unsigned char* end = stored + entry.storedSize;
+
+    size_t out = 0;
+
+    while(out < asset.size)
+    {
+        if(end - p < 4)
+            return false;
+
+        uint32_t blockSize = Read32(p);
+        p += 4;
+
+        bool raw = (blockSize & PACK_BLOCK_RAW) != 0;
+        blockSize &= ~PACK_BLOCK_RAW;
+
+        size_t rawSize = asset.size - out < PACK_BLOCK_SIZE ? asset.size - out : PACK_BLOCK_SIZE;
+
+        if(blockSize > (size_t)(end - p))
+            return false;
+
+        if(raw)
+        {
+            if(blockSize != rawSize)
+                return false;
+
+            memcpy(asset.buffer + out, p, rawSize);
+        }
+        else if(!DecompressBlock(p, (int)blockSize, asset.buffer + out, (int)rawSize))
+            return false;
+
+        p += blockSize;
+        out += rawSize;
+    }
+
+    asset.data = asset.buffer;
+    return true;
+}
+
+bool TryOpenAsset(const char* name, AssetFile& asset)
+{
+    asset = AssetFile();
+
+    const PackEntry* entry = FindEntry(name);
+
+    if(entry)
+    {
+        if(ReadEntry(*entry, asset))
+            return true;
+
+        fprintf(stderr, "Asset pack entry '%s' is corrupt\n", name);
+        CloseAsset(asset);
+
+        return false;
+    }
+
+    if(!TryMapFile(name, asset.file))
+        return false;
+
+    asset.data = asset.file.data;
+    asset.size = asset.file.size;
+
+    return true;
+}
+
+AssetFile OpenAsset(const char* name)
+{
+    AssetFile asset;
+
+    if(!TryOpenAsset(name, asset))
+        CRASH("Failed to open asset '%s'\n", name);
+
+    return asset;
+}
+
+uint64_t GetAssetHash(AssetFile& asset)
+{
+    if(!asset.hashed)
+    {
+        asset.hash = HashBytes(asset.data, asset.size);
+        asset.hashed = true;
+    }
+
+    return asset.hash;
+}
+
+void CloseAsset(AssetFile& asset)
+{
+    free(asset.buffer);
+    UnmapFile(asset.file);
+
+    asset = AssetFile();
+}
+
+static void Align(std::vector<unsigned char>& out, size_t alignment)
+{
+    while(out.size() % alignment != 0)
+        out.push_back(0);
+}
+
+template <typename T>
+static void Append(std::vector<unsigned char>& out, const T* data, size_t count)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    out.insert(out.end(), bytes, bytes + sizeof(T) * count);
+}
+
+bool WritePack(const char* filename, int count, const char* const* names, const char* const* paths, bool compress)
+{
+    std::vector<int> order(count);
+
+    for(int i = 0; i < count; ++i)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), [names](int a, int b) {
+        return strcmp(names[a], names[b]) < 0;
+    });
+
+    std::vector<PackEntry> entries(count);
+    std::vector<char> nameTable;
+
+    for(int i = 0; i < count; ++i)
+    {
+        if(i > 0 && strcmp(names[order[i - 1]], names[order[i]]) == 0)
+        {
+            fprintf(stderr, "Duplicate asset '%s'\n", names[order[i]]);
+            return false;
+        }
+
+        entries[i].nameOffset = (uint32_t)nameTable.size();
+
+        const char* name = names[order[i]];
+        nameTable.insert(nameTable.end(), name, name + strlen(name) + 1);
+    }
+
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = PACK_FILE_MAGIC;
+    header.version = PACK_FILE_VERSION;
+    header.entryCount = (uint32_t)count;
+    header.tocOffset = sizeof(PackHeader);
+    header.nameOffset = (uint32_t)(header.tocOffset + sizeof(PackEntry) * count);
+    header.nameSize = (uint32_t)nameTable.size();
+
+    // Header and TOC are filled in at the end
+    std::vector<unsigned char> out(header.nameOffset);
+
+    Append(out, nameTable.data(), nameTable.size());
+
+    std::vector<unsigned char> stored;
+    std::vector<unsigned char> block;
+
+    for(int i = 0; i < count; ++i)
+    {
+        const char* path = paths[order[i]];
+
+        MappedFile file;
+
+        // Empty files can't be mapped
+        if(!TryMapFile(path, file))
+        {
+            FILE* f = fopen(path, "rb");
+
+            if(!f)
+            {
+                fprintf(stderr, "Failed to open '%s'\n", path);
+                return false;
+            }
+
+            fclose(f);
+        }
+
+        PackEntry& entry = entries[i];
+
+        entry.size = file.size;
+        entry.hash = HashBytes(file.data, file.size);
+
+        stored.clear();
+
+        if(compress && file.size > 0)
+        {
+            for(size_t offset = 0; offset < file.size; offset += PACK_BLOCK_SIZE)
+            {
+                int size = (int)(file.size - offset < PACK_BLOCK_SIZE ? file.size - offset : PACK_BLOCK_SIZE);
+
+                block.clear();
+                CompressBlock(file.data + offset, size, block);
+
+                uint32_t blockSize = (uint32_t)block.size();
+
+                if(block.size() >= (size_t)size)
+                {
+                    blockSize = (uint32_t)size | PACK_BLOCK_RAW;
+                    block.assign(file.data + offset, file.data + offset + size);
+                }
+
+                Append(stored, &blockSize, 1);
+                stored.insert(stored.end(), block.begin(), block.end());
+            }
+        }
+
+        Align(out, PACK_DATA_ALIGNMENT);
+        entry.offset = out.size();
+
+        if(!stored.empty() && stored.size() <= file.size * (1.0f - PACK_MIN_SAVING))
+        {
+            entry.flags = PACK_ENTRY_COMPRESSED;
+            entry.storedSize = stored.size();
+
+            out.insert(out.end(), stored.begin(), stored.end());
+        }
+        else
+        {
+            entry.flags = 0;
+            entry.storedSize = file.size;
+
+            out.insert(out.end(), file.data, file.data + file.size);
+        }
+
+        UnmapFile(file);
+    }
+
+    memcpy(out.data(), &header, sizeof(header));
+    memcpy(out.data() + header.tocOffset, entries.data(), sizeof(PackEntry) * count);
+
+    return WriteFileAtomic(filename, out.data(), out.size());
+}
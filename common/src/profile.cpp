@@ -0,0 +1,379 @@
+#include <SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "profile.hpp"
+#include "draw.hpp"
+#include "resources.hpp"
+#include "utils.hpp"
+
+struct ProfileEvent
+{
+    const char* name;
+    uint64_t start, end;
+    int depth;
+};
+
+// Only the owning thread writes to this. Readers look at events below
+// written and throw away any the writer may have lapped meanwhile.
+struct ProfileThread
+{
+    char name[32];
+    int index;
+
+    ProfileEvent* events;
+    std::atomic<uint64_t> written;
+
+    // Open scopes
+    int depth;
+    const char* names[PROFILE_MAX_DEPTH];
+    uint64_t starts[PROFILE_MAX_DEPTH];
+};
+
+static struct
+{
+    std::mutex mutex;
+
+    ProfileThread* threads[PROFILE_MAX_THREADS] = {};
+    std::atomic<int> threadCount{0};
+
+    // Start of each frame (ring of PROFILE_MAX_FRAMES), under the mutex
+    uint64_t frames[PROFILE_MAX_FRAMES] = {};
+    int64_t frameCount = 0;
+} Profiler;
+
+static thread_local ProfileThread* CurrentThread = nullptr;
+
+static ProfileThread* GetThread()
+{
+    if(CurrentThread)
+        return CurrentThread;
+
+    std::lock_guard<std::mutex> lock(Profiler.mutex);
+
+    int index = Profiler.threadCount.load();
+
+    if(index >= PROFILE_MAX_THREADS)
+        CRASH("Too many profiled threads (max %d)\n", PROFILE_MAX_THREADS);
+
+    ProfileThread* thread = new ProfileThread();
+
+    snprintf(thread->name, sizeof(thread->name), "Thread %d", index);
+    thread->index = index;
+    thread->events = new ProfileEvent[PROFILE_MAX_EVENTS];
+    thread->written = 0;
+    thread->depth = 0;
+
+    Profiler.threads[index] = thread;
+    Profiler.threadCount.store(index + 1);
+
+    CurrentThread = thread;
+
+    return thread;
+}
+
+void BeginProfile(const char* name)
+{
+    ProfileThread* thread = GetThread();
+
+    // Too deep to record, but still counted so EndProfile pairs up
+    if(thread->depth < PROFILE_MAX_DEPTH)
+    {
+        thread->names[thread->depth] = name;
+        thread->starts[thread->depth] = SDL_GetPerformanceCounter();
+    }
+
+    thread->depth += 1;
+}
+
+void EndProfile()
+{
+    ProfileThread* thread = GetThread();
+
+    if(thread->depth <= 0)
+        return;
+
+    thread->depth -= 1;
+
+    if(thread->depth >= PROFILE_MAX_DEPTH)
+        return;
+
+    uint64_t written = thread->written.load(std::memory_order_relaxed);
+
+    ProfileEvent& event = thread->events[written % PROFILE_MAX_EVENTS];
+
+    event.name = thread->names[thread->depth];
+    event.start = thread->starts[thread->depth];
+    event.end = SDL_GetPerformanceCounter();
+    event.depth = thread->depth;
+
+    thread->written.store(written + 1, std::memory_order_release);
+}
+
+void SetProfileThreadName(const char* name)
+{
+    ProfileThread* thread = GetThread();
+
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+void MarkProfileFrame()
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    std::lock_guard<std::mutex> lock(Profiler.mutex);
+
+    Profiler.frames[Profiler.frameCount % PROFILE_MAX_FRAMES] = now;
+    Profiler.frameCount += 1;
+}
+
+// Up to count of the latest frame starts, oldest first
+static int GetFrames(uint64_t* frames, int count)
+{
+    std::lock_guard<std::mutex> lock(Profiler.mutex);
+
+    int64_t available = std::min<int64_t>(Profiler.frameCount, PROFILE_MAX_FRAMES);
+
+    if(count > available)
+        count = (int)available;
+
+    for(int i = 0; i < count; ++i)
+        frames[i] = Profiler.frames[(Profiler.frameCount - count + i) % PROFILE_MAX_FRAMES];
+
+    return count;
+}
+
+// Appends the thread's events which ended at or after since, newest first
+static void CopyEvents(ProfileThread& thread, uint64_t since, std::vector<ProfileEvent>& events)
+{
+    size_t first = events.size();
+
+    uint64_t written = thread.written.load(std::memory_order_acquire);
+    uint64_t oldest = written > PROFILE_MAX_EVENTS ? written - PROFILE_MAX_EVENTS : 0;
+
+    uint64_t i = written;
+
+    for(; i > oldest; --i)
+    {
+        const ProfileEvent& event = thread.events[(i - 1) % PROFILE_MAX_EVENTS];
+
+        // Events are written in the order they end
+        if(event.end < since)
+            break;
+
+        events.push_back(event);
+    }
+
+    // Drop whatever was overwritten while we were copying, including the
+    // slot the writer may be partway through filling (index after)
+    uint64_t after = thread.written.load(std::memory_order_acquire);
+    uint64_t valid = after + 1 > PROFILE_MAX_EVENTS ? after + 1 - PROFILE_MAX_EVENTS : 0;
+
+    if(valid > i)
+    {
+        size_t lapped = (size_t)std::min<uint64_t>(valid - i, events.size() - first);
+        events.resize(events.size() - lapped);
+    }
+}
+
+int GetProfileStats(ProfileStat* stats, int maxCount)
+{
+    uint64_t frames[PROFILE_STAT_FRAMES + 1];
+    int frameCount = GetFrames(frames, PROFILE_STAT_FRAMES + 1);
+
+    // Need at least one complete frame
+    if(frameCount < 2)
+        return 0;
+
+    int completeFrames = frameCount - 1;
+
+    std::vector<ProfileEvent> events;
+
+    int threadCount = Profiler.threadCount.load();
+
+    for(int i = 0; i < threadCount; ++i)
+        CopyEvents(*Profiler.threads[i], frames[0], events);
+
+    if(maxCount > PROFILE_MAX_STATS)
+        maxCount = PROFILE_MAX_STATS;
+
+    // Time per scope per frame
+    std::vector<double> totals;
+    std::vector<int> calls;
+
+    int count = 0;
+
+    for(const ProfileEvent& event : events)
+    {
+        // Attribute it to the frame it started in
+        if(event.start < frames[0] || event.start >= frames[completeFrames])
+            continue;
+
+        int frame = (int)(std::upper_bound(frames, frames + frameCount, event.start) - frames) - 1;
+
+        int s = 0;
+
+        while(s < count && stats[s].name != event.name && strcmp(stats[s].name, event.name) != 0)
+            s += 1;
+
+        if(s == count)
+        {
+            if(count == maxCount)
+                continue;
+
+            stats[count].name = event.name;
+            count += 1;
+
+            totals.resize(count * completeFrames, 0.0);
+            calls.resize(count, 0);
+        }
+
+        totals[s * completeFrames + frame] += (double)(event.end - event.start);
+        calls[s] += 1;
+    }
+
+    double msPerTick = 1000.0 / SDL_GetPerformanceFrequency();
+
+    for(int s = 0; s < count; ++s)
+    {
+        double sum = 0, max = 0;
+
+        for(int f = 0; f < completeFrames; ++f)
+        {
+            double t = totals[s * completeFrames + f];
+
+            sum += t;
+            max = std::max(max, t);
+        }
+
+        stats[s].averageMs = sum / completeFrames * msPerTick;
+        stats[s].maxMs = max * msPerTick;
+        stats[s].calls = calls[s] / (float)completeFrames;
+    }
+
+    std::sort(stats, stats + count, [](const ProfileStat& a, const ProfileStat& b) {
+        return a.averageMs > b.averageMs;
+    });
+
+    return count;
+}
+
+// Names are literals, but escape them anyway so the JSON stays valid
+static void WriteJsonString(FILE* file, const char* text)
+{
+    fputc('"', file);
+
+    for(; *text; ++text)
+    {
+        if(*text == '"' || *text == '\\')
+            fputc('\\', file);
+
+        fputc(*text, file);
+    }
+
+    fputc('"', file);
+}
+
+void WriteProfileTrace(const char* filename)
+{
+    uint64_t frames[PROFILE_MAX_FRAMES];
+    int frameCount = GetFrames(frames, PROFILE_MAX_FRAMES);
+
+    if(frameCount == 0)
+    {
+        printf("No profiled frames to write\n");
+        return;
+    }
+
+    FILE* file = fopen(filename, "w");
+
+    if(!file)
+    {
+        printf("Failed to open %s for the profile trace\n", filename);
+        return;
+    }
+
+    double usPerTick = 1000000.0 / SDL_GetPerformanceFrequency();
+    uint64_t origin = frames[0];
+
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    bool first = true;
+
+    int threadCount = Profiler.threadCount.load();
+
+    std::vector<ProfileEvent> events;
+
+    for(int i = 0; i < threadCount; ++i)
+    {
+        const ProfileThread& thread = *Profiler.threads[i];
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", thread.index);
+        WriteJsonString(file, thread.name);
+        fprintf(file, "}}");
+
+        first = false;
+
+        events.clear();
+        CopyEvents(*Profiler.threads[i], origin, events);
+
+        for(const ProfileEvent& event : events)
+        {
+            if(event.start < origin)
+                continue;
+
+            fprintf(file, ",\n{\"name\":");
+            WriteJsonString(file, event.name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    thread.index, (event.start - origin) * usPerTick, (event.end - event.start) * usPerTick);
+        }
+    }
+
+    for(int i = 0; i < frameCount; ++i)
+        fprintf(file, ",\n{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}", (frames[i] - origin) * usPerTick);
+
+    fprintf(file, "\n]}\n");
+
+    fclose(file);
+
+    printf("Wrote %d frames of profile trace to %s\n", frameCount, filename);
+}
+
+void DrawProfileOverlay(const Font& font, float x, float y)
+{
+    ProfileStat stats[PROFILE_MAX_STATS];
+    int count = GetProfileStats(stats, PROFILE_MAX_STATS);
+
+    const int columns = 46;
+    const float lineHeight = font.height;
+
+    // Assumes a monospace font about half as wide as it is tall
+    SetDrawColor(0, 0, 0);
+    FillRect(x - 4, y - 4, columns * font.height * 0.55f + 8, lineHeight * (count + 1) + 8);
+
+    char line[128];
+
+#ifndef PROFILE_ENABLED
+    SetDrawColor(1, 1, 0);
+    FillText(font, x, y, "Built without the profiler (-DPROFILE=ON)");
+    return;
+#endif
+
+    SetDrawColor(1, 1, 0);
+    snprintf(line, sizeof(line), "%-22s %7s %7s %6s", "scope", "avg ms", "max ms", "calls");
+    FillText(font, x, y, line);
+
+    SetDrawColor(1, 1, 1);
+
+    for(int i = 0; i < count; ++i)
+    {
+        y += lineHeight;
+
+        snprintf(line, sizeof(line), "%-22.22s %7.2f %7.2f %6.1f", stats[i].name, stats[i].averageMs, stats[i].maxMs, stats[i].calls);
+        FillText(font, x, y, line);
+    }
+}
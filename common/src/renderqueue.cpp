@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "renderqueue.hpp"
+#include "graphics.hpp"
+#include "resources.hpp"
+#include "glstate.hpp"
+#include "profile.hpp"
+#include "utils.hpp"
+
+static const int ITEM_BITS = 16;
+
+#ifdef PROFILE_ENABLED
+static const char* PASS_NAMES[RENDER_PASS_COUNT] = { "Draw opaque", "Draw debug", "Draw HUD" };
+#endif
+
+static uint64_t GetSortKey(const RenderItem& item, int index)
+{
+    uint64_t pass = (uint64_t)item.pass & 0xF;
+    uint64_t program = item.shader ? item.shader->id & 0xFFF : 0;
+    uint64_t texture = item.textures[0] & 0xFFFF;
+    uint64_t vertexArray = item.mesh ? item.mesh->vertexArray & 0xFFFF : 0;
+
+    return (pass << 60) | (program << 48) | (texture << 32) | (vertexArray << 16) | (uint64_t)index;
+}
+
+// Least significant digit first, 8 bits at a time. The keys arrive in
+// submission order and the sort is stable, so the item bits never need
+// sorting and ties keep their submission order.
+static void RadixSort(RenderQueue& queue)
+{
+    uint64_t* src = queue.keys;
+    uint64_t* dst = queue.scratch;
+
+    for(int shift = ITEM_BITS; shift < 64; shift += 8)
+    {
+        int counts[256] = {};
+
+        for(int i = 0; i < queue.count; ++i)
+            counts[(src[i] >> shift) & 0xFF] += 1;
+
+        // Every key has the same digit here
+        if(counts[(src[0] >> shift) & 0xFF] == queue.count)
+            continue;
+
+        int offset = 0;
+
+        for(int i = 0; i < 256; ++i)
+        {
+            int count = counts[i];
+            counts[i] = offset;
+            offset += count;
+        }
+
+        for(int i = 0; i < queue.count; ++i)
+            dst[counts[(src[i] >> shift) & 0xFF]++] = src[i];
+
+        uint64_t* temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    if(src != queue.keys)
+        memcpy(queue.keys, src, sizeof(uint64_t) * queue.count);
+}
+
+static void BeginPass(RenderPass pass)
+{
+    switch(pass)
+    {
+        case RENDER_PASS_DEBUG:
+            SetDepthTest(false);
+            SetPolygonMode(GL_LINE);
+            break;
+
+        case RENDER_PASS_HUD:
+            SetDepthTest(false);
+            SetPolygonMode(GL_FILL);
+            break;
+
+        default:
+            SetDepthTest(true);
+            SetPolygonMode(GL_FILL);
+            break;
+    }
+}
+
+void Submit(RenderQueue& queue, const RenderItem& item)
+{
+    if(queue.count >= RENDER_QUEUE_MAX_ITEMS)
+        CRASH("Too many render items (max %d)\n", RENDER_QUEUE_MAX_ITEMS);
+
+    if(queue.count == queue.capacity)
+    {
+        queue.capacity = queue.capacity ? queue.capacity * 2 : 256;
+
+        queue.items = (RenderItem*)realloc(queue.items, sizeof(RenderItem) * queue.capacity);
+        queue.keys = (uint64_t*)realloc(queue.keys, sizeof(uint64_t) * queue.capacity);
+        queue.scratch = (uint64_t*)realloc(queue.scratch, sizeof(uint64_t) * queue.capacity);
+    }
+
+    queue.items[queue.count] = item;
+    queue.keys[queue.count] = GetSortKey(item, queue.count);
+
+    queue.count += 1;
+}
+
+void FlushRenderQueue(RenderQueue& queue)
+{
+    if(queue.count > 0)
+    {
+        PROFILE_SCOPE("Sort");
+        RadixSort(queue);
+    }
+
+    int pass = -1;
+
+    for(int i = 0; i < queue.count; ++i)
+    {
+        const RenderItem& item = queue.items[queue.keys[i] & ((1 << ITEM_BITS) - 1)];
+
+        if(item.pass != pass)
+        {
+            if(pass >= 0)
+                PROFILE_END();
+
+            PROFILE_BEGIN(PASS_NAMES[item.pass]);
+
+            BeginPass(item.pass);
+            pass = item.pass;
+        }
+
+        if(item.shader)
+            UseProgram(item.shader->id);
+
+        for(int j = 0; j < RENDER_ITEM_TEXTURES; ++j)
+        {
+            if(item.textures[j])
+                BindTexture(item.textures[j], j);
+        }
+
+        if(item.draw)
+        {
+            item.draw(queue, item);
+            continue;
+        }
+
+        if(item.shader)
+            glUniformMatrix4fv(item.shader->uniforms[UNIFORM_MODEL], 1, GL_FALSE, &item.model[0][0]);
+
+        Draw(*item.mesh);
+    }
+
+    if(pass >= 0)
+        PROFILE_END();
+
+    BeginPass(RENDER_PASS_OPAQUE);
+
+    queue.count = 0;
+}
+
+void DestroyRenderQueue(RenderQueue& queue)
+{
+    free(queue.items);
+    free(queue.keys);
+    free(queue.scratch);
+
+    queue = RenderQueue();
+}
@@ -0,0 +1,132 @@
+#include <string.h>
+
+#include "replay.hpp"
+#include "utils.hpp"
+
+InputRecorder CreateInputRecorder(const char* filename, uint32_t seed)
+{
+    InputRecorder recorder;
+
+    recorder.file = fopen(filename, "wb");
+
+    if(!recorder.file)
+        CRASH("Failed to open %s for recording\n", filename);
+
+    ReplayHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = REPLAY_FILE_MAGIC;
+    header.version = REPLAY_FILE_VERSION;
+    header.seed = seed;
+
+    fwrite(&header, sizeof(header), 1, recorder.file);
+
+    return recorder;
+}
+
+static int16_t ClampMotion(int motion)
+{
+    if(motion < INT16_MIN)
+        return INT16_MIN;
+
+    if(motion > INT16_MAX)
+        return INT16_MAX;
+
+    return (int16_t)motion;
+}
+
+void Record(InputRecorder& recorder, const InputFrame& frame, float dt)
+{
+    // Only a handful of keys are ever down, so store those instead of
+    // the whole keyboard
+    uint16_t keys[UINT8_MAX];
+    int keyCount = 0;
+
+    for(int i = 0; i < SDL_NUM_SCANCODES && keyCount < UINT8_MAX; ++i)
+    {
+        if(frame.keys[i])
+            keys[keyCount++] = (uint16_t)i;
+    }
+
+    ReplayFrame stored;
+
+    stored.dt = dt;
+    stored.mouseX = ClampMotion(frame.mouseX);
+    stored.mouseY = ClampMotion(frame.mouseY);
+    stored.flags = frame.shoot ? REPLAY_FRAME_SHOOT : 0;
+    stored.keyCount = (uint8_t)keyCount;
+
+    fwrite(&stored, sizeof(stored), 1, recorder.file);
+    fwrite(keys, sizeof(uint16_t), keyCount, recorder.file);
+
+    recorder.frameCount += 1;
+}
+
+void DestroyInputRecorder(InputRecorder& recorder)
+{
+    if(recorder.file)
+        fclose(recorder.file);
+
+    recorder = InputRecorder();
+}
+
+InputReplay OpenInputReplay(const char* filename)
+{
+    InputReplay replay;
+
+    replay.file = fopen(filename, "rb");
+
+    if(!replay.file)
+        CRASH("Failed to open recording %s\n", filename);
+
+    ReplayHeader header;
+
+    if(fread(&header, sizeof(header), 1, replay.file) != 1 || header.magic != REPLAY_FILE_MAGIC)
+        CRASH("%s isn't an input recording\n", filename);
+
+    if(header.version != REPLAY_FILE_VERSION)
+        CRASH("%s is version %u, expected %u\n", filename, header.version, REPLAY_FILE_VERSION);
+
+    replay.seed = header.seed;
+
+    return replay;
+}
+
+bool NextReplayFrame(InputReplay& replay, InputFrame& frame, float& dt)
+{
+    ReplayFrame stored;
+
+    if(fread(&stored, sizeof(stored), 1, replay.file) != 1)
+        return false;
+
+    uint16_t keys[UINT8_MAX];
+
+    if(fread(keys, sizeof(uint16_t), stored.keyCount, replay.file) != stored.keyCount)
+        return false;
+
+    frame = InputFrame();
+
+    for(int i = 0; i < stored.keyCount; ++i)
+    {
+        if(keys[i] < SDL_NUM_SCANCODES)
+            frame.keys[keys[i]] = 1;
+    }
+
+    frame.mouseX = stored.mouseX;
+    frame.mouseY = stored.mouseY;
+    frame.shoot = (stored.flags & REPLAY_FRAME_SHOOT) != 0;
+
+    dt = stored.dt;
+
+    replay.frameCount += 1;
+
+    return true;
+}
+
+void CloseInputReplay(InputReplay& replay)
+{
+    if(replay.file)
+        fclose(replay.file);
+
+    replay = InputReplay();
+}
@@ -1,8 +1,11 @@
 #include <assert.h>
+#include <string.h>
 #include <stb_image.h>
 
 #include "resources.hpp"
 #include "graphics.hpp"
+#include "glstate.hpp"
+#include "hash.hpp"
 #include "utils.hpp"
 
 static unsigned char FontDataBuffer[1 << 20];
@@ -14,7 +17,7 @@ static GLuint CreateTexture(GLuint internalFormat, GLuint format, const unsigned
 
 	glGenTextures(1, &texture);
 
-	glBindTexture(GL_TEXTURE_2D, texture);
+	BindTexture(texture);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -24,216 +27,1214 @@ static GLuint CreateTexture(GLuint internalFormat, GLuint format, const unsigned
 	return texture;
 }
 
+static int GetLevelCount(int width, int height)
+{
+    int levelCount = 1;
+
+    while((width > 1 || height > 1) && levelCount < MAX_TEXTURE_LEVELS)
+    {
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+
+        levelCount += 1;
+    }
+
+    return levelCount;
+}
+
+inline static int LevelWidth(const TextureData& data, int level)
+{
+    int w = data.width >> level;
+    return w > 0 ? w : 1;
+}
+
+inline static int LevelHeight(const TextureData& data, int level)
+{
+    int h = data.height >> level;
+    return h > 0 ? h : 1;
+}
+
+// Averages 2x2 blocks of the source level. Odd edges reuse the last
+// row/column.
+static void DownsampleLevel(const unsigned char* src, int sw, int sh, unsigned char* dst, int dw, int dh)
+{
+    for(int y = 0; y < dh; ++y)
+    {
+        int y0 = y * 2 < sh ? y * 2 : sh - 1;
+        int y1 = y * 2 + 1 < sh ? y * 2 + 1 : sh - 1;
+
+        for(int x = 0; x < dw; ++x)
+        {
+            int x0 = x * 2 < sw ? x * 2 : sw - 1;
+            int x1 = x * 2 + 1 < sw ? x * 2 + 1 : sw - 1;
+
+            const unsigned char* a = &src[(y0 * sw + x0) * 4];
+            const unsigned char* b = &src[(y0 * sw + x1) * 4];
+            const unsigned char* c = &src[(y1 * sw + x0) * 4];
+            const unsigned char* d = &src[(y1 * sw + x1) * 4];
+
+            unsigned char* out = &dst[(y * dw + x) * 4];
+
+            for(int i = 0; i < 4; ++i)
+                out[i] = (unsigned char)((a[i] + b[i] + c[i] + d[i] + 2) / 4);
+        }
+    }
+}
+
+static void GetTextureCachePath(uint64_t hash, char* path, size_t size)
+{
+    snprintf(path, size, CACHE_DIR "/%016llx.tex", (unsigned long long)hash);
+}
+
+static bool LoadCachedTextureData(const char* path, uint64_t hash, TextureData& data)
+{
+    MappedFile file;
+
+    if(!TryMapFile(path, file))
+        return false;
+
+    const TextureCacheHeader* header = (const TextureCacheHeader*)file.data;
+
+    bool valid = file.size >= sizeof(TextureCacheHeader) &&
+                 header->magic == TEXTURE_CACHE_MAGIC &&
+                 header->version == TEXTURE_CACHE_VERSION &&
+                 header->sourceHash == hash &&
+                 header->width > 0 && header->height > 0 &&
+                 header->levelCount > 0 && header->levelCount <= MAX_TEXTURE_LEVELS;
+
+    if(valid)
+    {
+        data.width = header->width;
+        data.height = header->height;
+        data.levelCount = header->levelCount;
+
+        for(int i = 0; i < data.levelCount; ++i)
+        {
+            size_t levelSize = (size_t)LevelWidth(data, i) * LevelHeight(data, i) * 4;
+
+            if(header->levelOffset[i] + levelSize > file.size)
+            {
+                valid = false;
+                break;
+            }
+
+            data.levels[i] = file.data + header->levelOffset[i];
+        }
+    }
+
+    if(!valid)
+    {
+        UnmapFile(file);
+        data = TextureData();
+
+        return false;
+    }
+
+    data.file = file;
+    return true;
+}
+
+// Best effort; failing to write the cache only costs a decode next time
+static void SaveCachedTextureData(const char* path, uint64_t hash, const TextureData& data)
+{
+    if(!MakeDirectory(CACHE_DIR))
+        return;
+
+    TextureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = TEXTURE_CACHE_MAGIC;
+    header.version = TEXTURE_CACHE_VERSION;
+    header.sourceHash = hash;
+    header.width = data.width;
+    header.height = data.height;
+    header.levelCount = data.levelCount;
+
+    size_t size = sizeof(header);
+
+    for(int i = 0; i < data.levelCount; ++i)
+    {
+        header.levelOffset[i] = (uint32_t)size;
+        size += (size_t)LevelWidth(data, i) * LevelHeight(data, i) * 4;
+    }
+
+    unsigned char* buffer = (unsigned char*)malloc(size);
+
+    if(!buffer)
+        return;
+
+    memcpy(buffer, &header, sizeof(header));
+
+    for(int i = 0; i < data.levelCount; ++i)
+        memcpy(buffer + header.levelOffset[i], data.levels[i], (size_t)LevelWidth(data, i) * LevelHeight(data, i) * 4);
+
+    if(!WriteFileAtomic(path, buffer, size))
+        fprintf(stderr, "Failed to write texture cache file '%s'\n", path);
+
+    free(buffer);
+}
+
+TextureData LoadTextureData(const char* filename)
+{
+    AssetFile source;
+
+    if(!TryOpenAsset(filename, source))
+        CRASH("Failed to load texture '%s'\n", filename);
+
+    uint64_t hash = GetAssetHash(source);
+
+    char cachePath[256];
+    GetTextureCachePath(hash, cachePath, sizeof(cachePath));
+
+    TextureData data;
+
+    if(LoadCachedTextureData(cachePath, hash, data))
+    {
+        CloseAsset(source);
+        return data;
+    }
+
+    int width, height, n;
+
+    unsigned char* image = stbi_load_from_memory(source.data, (int)source.size, &width, &height, &n, 4);
+
+    CloseAsset(source);
+
+    if(!image)
+        CRASH("Failed to load texture '%s'\n", filename);
+
+    data.width = width;
+    data.height = height;
+    data.levelCount = GetLevelCount(width, height);
+
+    size_t offsets[MAX_TEXTURE_LEVELS];
+    size_t size = 0;
+
+    for(int i = 0; i < data.levelCount; ++i)
+    {
+        offsets[i] = size;
+        size += (size_t)LevelWidth(data, i) * LevelHeight(data, i) * 4;
+    }
+
+    data.pixels = (unsigned char*)malloc(size);
+
+    if(!data.pixels)
+        CRASH("Out of memory\n");
+
+    for(int i = 0; i < data.levelCount; ++i)
+        data.levels[i] = data.pixels + offsets[i];
+
+    memcpy(data.levels[0], image, (size_t)width * height * 4);
+    stbi_image_free(image);
+
+    for(int i = 1; i < data.levelCount; ++i)
+    {
+        DownsampleLevel(data.levels[i - 1], LevelWidth(data, i - 1), LevelHeight(data, i - 1),
+                        data.levels[i], LevelWidth(data, i), LevelHeight(data, i));
+    }
+
+    SaveCachedTextureData(cachePath, hash, data);
+
+    return data;
+}
+
+Texture CreateTexture(const TextureData& data)
+{
+    Texture texture;
+
+    glGenTextures(1, &texture.id);
+    BindTexture(texture.id);
+
+    // Minified walls and sprites sample the mip chain
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, data.levelCount > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, data.levelCount - 1);
+
+    for(int i = 0; i < data.levelCount; ++i)
+    {
+        glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, LevelWidth(data, i), LevelHeight(data, i), 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, data.levels[i]);
+    }
+
+    texture.width = data.width;
+    texture.height = data.height;
+
+    return texture;
+}
+
+void DestroyTextureData(TextureData& data)
+{
+    if(data.file.data)
+        UnmapFile(data.file);
+    else
+        free(data.pixels);
+
+    data = TextureData();
+}
+
 Texture LoadTexture(const char* filename)
 {
-	int width, height, n;
+    TextureData data = LoadTextureData(filename);
+
+    Texture texture = CreateTexture(data);
+
+    DestroyTextureData(data);
+
+    return texture;
+}
+
+// KHR_parallel_shader_compile (not in our gl3w)
+static const GLenum GL_COMPLETION_STATUS = 0x91B1;
+typedef void (*MaxShaderCompilerThreadsProc)(GLuint count);
+
+// A program whose compile/link has been issued but not checked yet
+struct PendingProgram
+{
+    GLuint program = 0;
+    GLuint vertexShader = 0, fragmentShader = 0;
+
+    uint64_t cacheKey = 0;
+    const char* name = nullptr;
+};
+
+static bool SupportsProgramBinaries()
+{
+    if(!glGetProgramBinary || !glProgramBinary)
+        return false;
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+
+    return formatCount > 0;
+}
+
+// Which of KHR/ARB_parallel_shader_compile the driver lists, if either.
+// Checked by name since GLX hands out entry points for anything.
+static const char* FindParallelShaderCompile()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+    for(int i = 0; i < count; ++i)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+
+        if(!name)
+            continue;
+
+        if(strcmp(name, "GL_KHR_parallel_shader_compile") == 0)
+            return "glMaxShaderCompilerThreadsKHR";
+
+        if(strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+            return "glMaxShaderCompilerThreadsARB";
+    }
+
+    return nullptr;
+}
+
+// Asks the driver to compile on its own threads if it can. Returns true
+// if GL_COMPLETION_STATUS can be polled.
+static bool EnableParallelShaderCompile()
+{
+    static bool enabled = false;
+    static bool supported = false;
+
+    if(enabled)
+        return supported;
+
+    enabled = true;
+
+    const char* procName = FindParallelShaderCompile();
+
+    if(!procName)
+        return false;
+
+    MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)gl3wGetProcAddress(procName);
+
+    // 0xFFFFFFFF lets the driver pick the number of threads
+    if(maxThreads)
+        maxThreads(0xFFFFFFFF);
+
+    // The completion query comes with the extension either way
+    supported = true;
+
+    return supported;
+}
+
+// Binaries are only valid for the exact driver that produced them
+static uint64_t GetShaderCacheKey(const char* vertexSource, const char* fragmentSource)
+{
+    const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+
+    uint64_t hash = HASH_SEED;
+
+    for(size_t i = 0; i < COUNT_OF(strings); ++i)
+    {
+        const char* str = (const char*)glGetString(strings[i]);
+
+        if(str)
+            hash = HashBytes(str, strlen(str) + 1, hash);
+    }
+
+    hash = HashBytes(vertexSource, strlen(vertexSource) + 1, hash);
+    hash = HashBytes(fragmentSource, strlen(fragmentSource) + 1, hash);
+
+    return hash;
+}
+
+static void GetShaderCachePath(uint64_t key, char* path, size_t size)
+{
+    snprintf(path, size, CACHE_DIR "/%016llx.prog", (unsigned long long)key);
+}
+
+static GLuint LoadCachedProgram(uint64_t key)
+{
+    char path[256];
+    GetShaderCachePath(key, path, sizeof(path));
+
+    MappedFile file;
+
+    if(!TryMapFile(path, file))
+        return 0;
+
+    const ShaderCacheHeader* header = (const ShaderCacheHeader*)file.data;
+
+    if(file.size < sizeof(ShaderCacheHeader) ||
+       header->magic != SHADER_CACHE_MAGIC ||
+       header->version != SHADER_CACHE_VERSION ||
+       header->key != key ||
+       sizeof(ShaderCacheHeader) + (size_t)header->length > file.size)
+    {
+        UnmapFile(file);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+
+    glProgramBinary(program, header->format, file.data + sizeof(ShaderCacheHeader), header->length);
+
+    UnmapFile(file);
+
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+    // The driver is allowed to reject binaries (e.g. after an update),
+    // in which case we just compile from source
+    if(success == GL_FALSE)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+// Best effort, like the texture cache
+static void SaveCachedProgram(uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if(length <= 0 || !MakeDirectory(CACHE_DIR))
+        return;
+
+    size_t size = sizeof(ShaderCacheHeader) + length;
+    unsigned char* buffer = (unsigned char*)malloc(size);
+
+    if(!buffer)
+        return;
+
+    ShaderCacheHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = SHADER_CACHE_MAGIC;
+    header.version = SHADER_CACHE_VERSION;
+    header.key = key;
+
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &header.format, buffer + sizeof(ShaderCacheHeader));
+
+    header.length = (uint32_t)written;
+    memcpy(buffer, &header, sizeof(header));
+
+    char path[256];
+    GetShaderCachePath(key, path, sizeof(path));
+
+    if(written <= 0 || !WriteFileAtomic(path, buffer, sizeof(ShaderCacheHeader) + written))
+        fprintf(stderr, "Failed to write shader cache file '%s'\n", path);
+
+    free(buffer);
+}
+
+// Issues the compile and link without waiting on the results, so
+// several programs can be in flight at once
+static void BeginShaderProgram(PendingProgram& pending, const char* vertexSource, const char* fragmentSource, bool retrievable)
+{ 
+	GLuint vertexShader, fragmentShader;
+	
+	vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+
+	glShaderSource(vertexShader, 1, &vertexSource, NULL);
+	glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+
+	glCompileShader(vertexShader);
+	glCompileShader(fragmentShader);
+
+	GLuint program = glCreateProgram();
+
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+
+	if(retrievable)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	glLinkProgram(program);
+
+	pending.program = program;
+	pending.vertexShader = vertexShader;
+	pending.fragmentShader = fragmentShader;
+}
+
+// Blocks until the program is linked
+static void FinishShaderProgram(PendingProgram& pending)
+{
+	GLint success = 0;
+
+	static char log[2048];
+
+	glGetShaderiv(pending.vertexShader, GL_COMPILE_STATUS, &success);
+
+	if (success == GL_FALSE)
+	{
+		glGetShaderInfoLog(pending.vertexShader, sizeof(log), NULL, log);
+		CRASH("Vertex shader compilation failed (%s): %s\n", pending.name, log);
+	}
+
+	glGetShaderiv(pending.fragmentShader, GL_COMPILE_STATUS, &success);
+
+	if (success == GL_FALSE)
+	{
+		glGetShaderInfoLog(pending.fragmentShader, sizeof(log), NULL, log);
+		CRASH("Fragment shader compilation failed (%s): %s\n", pending.name, log);
+	}
+
+	glGetProgramiv(pending.program, GL_LINK_STATUS, &success);
 	
-	unsigned char* data = stbi_load(filename, &width, &height, &n, 4);
-	if (!data)
-	    CRASH("Failed to load texture '%s'\n", filename);
+	if (success == GL_FALSE)
+	{
+		glGetProgramInfoLog(pending.program, sizeof(log), NULL, log);
+		CRASH("Shader program linking failed (%s): %s\n", pending.name, log);
+	}
+
+	glDetachShader(pending.program, pending.vertexShader);
+	glDetachShader(pending.program, pending.fragmentShader);
+
+    glDeleteShader(pending.vertexShader);
+    glDeleteShader(pending.fragmentShader);
+}
+
+// Finishes the program and caches its binary
+static void CompleteShaderProgram(PendingProgram& pending, Shader& shader, bool binaries)
+{
+    FinishShaderProgram(pending);
+
+    shader.id = pending.program;
+
+    if(binaries)
+        SaveCachedProgram(pending.cacheKey, shader.id);
+}
+
+// Indexed by UniformId
+static const char* const UNIFORM_NAMES[] =
+{
+    "model",
+    "tex",
+    "yaw",
+    "frameSize",
+    "columns"
+};
+
+static_assert(COUNT_OF(UNIFORM_NAMES) == UNIFORM_COUNT, "Missing uniform names");
+
+// Caches the locations of the program's active uniforms and points its
+// Camera block at the shared binding
+static void ReflectShader(Shader& shader)
+{
+    for(int i = 0; i < UNIFORM_COUNT; ++i)
+        shader.uniforms[i] = -1;
+
+    GLint count = 0;
+    glGetProgramiv(shader.id, GL_ACTIVE_UNIFORMS, &count);
+
+    for(int i = 0; i < count; ++i)
+    {
+        char name[64];
+        GLsizei length = 0;
+
+        glGetActiveUniformName(shader.id, i, sizeof(name), &length, name);
+
+        // Arrays are reported as "name[0]"
+        char* bracket = strchr(name, '[');
+
+        if(bracket)
+            *bracket = '\0';
+
+        for(int j = 0; j < UNIFORM_COUNT; ++j)
+        {
+            if(strcmp(name, UNIFORM_NAMES[j]) == 0)
+                shader.uniforms[j] = glGetUniformLocation(shader.id, name);
+        }
+    }
+
+    GLuint camera = glGetUniformBlockIndex(shader.id, "Camera");
+
+    if(camera != GL_INVALID_INDEX)
+        glUniformBlockBinding(shader.id, camera, CAMERA_BLOCK_BINDING);
+}
+
+// Copies the asset into a NUL terminated string
+static char* ReadAssetString(const char* filename)
+{
+    AssetFile asset = OpenAsset(filename);
+
+    char* str = (char*)malloc(asset.size + 1);
+    
+    memcpy(str, asset.data, asset.size);
+    str[asset.size] = '\0';
+
+    CloseAsset(asset);
+
+    return str;
+}
+
+void LoadShaders(int count, const char* const* vertexFilenames, const char* const* fragmentFilenames, Shader* shaders)
+{
+    bool binaries = SupportsProgramBinaries();
+
+    bool parallel = EnableParallelShaderCompile();
+
+    PendingProgram* pending = (PendingProgram*)calloc(count, sizeof(PendingProgram));
+
+    // Kick off everything that isn't cached before waiting on any of it
+    for(int i = 0; i < count; ++i)
+    {
+        char* vertexSource = ReadAssetString(vertexFilenames[i]);
+        char* fragmentSource = ReadAssetString(fragmentFilenames[i]);
+
+        pending[i].name = vertexFilenames[i];
+
+        shaders[i] = Shader();
+
+        if(binaries)
+        {
+            pending[i].cacheKey = GetShaderCacheKey(vertexSource, fragmentSource);
+            shaders[i].id = LoadCachedProgram(pending[i].cacheKey);
+        }
+
+        if(!shaders[i].id)
+            BeginShaderProgram(pending[i], vertexSource, fragmentSource, binaries);
+
+        free(vertexSource);
+        free(fragmentSource);
+    }
+
+    int remaining = 0;
+
+    for(int i = 0; i < count; ++i)
+    {
+        if(!shaders[i].id)
+            remaining += 1;
+    }
+
+    // Finish programs in the order the driver completes them. If none
+    // has (or we can't ask), block on the first one still outstanding.
+    while(remaining > 0)
+    {
+        int first = -1;
+        int finished = 0;
+
+        for(int i = 0; i < count; ++i)
+        {
+            if(shaders[i].id)
+                continue;
+
+            if(first < 0)
+                first = i;
+
+            GLint complete = GL_FALSE;
+
+            if(parallel)
+                glGetProgramiv(pending[i].program, GL_COMPLETION_STATUS, &complete);
+
+            if(complete == GL_FALSE)
+                continue;
+
+            CompleteShaderProgram(pending[i], shaders[i], binaries);
+            finished += 1;
+        }
+
+        if(finished == 0)
+        {
+            CompleteShaderProgram(pending[first], shaders[first], binaries);
+            finished = 1;
+        }
+
+        remaining -= finished;
+    }
+
+    for(int i = 0; i < count; ++i)
+        ReflectShader(shaders[i]);
+
+    free(pending);
+}
+
+Shader LoadShader(const char* vertexFilename, const char* fragmentFilename)
+{
+    Shader shader;
+
+    LoadShaders(1, &vertexFilename, &fragmentFilename, &shader);
+
+    return shader;
+}
+
+// Appends to a malloc'd array, doubling its capacity as needed
+template <typename T>
+static void Push(T*& arr, int& count, int& capacity, const T& value)
+{
+    if(count >= capacity)
+    {
+        capacity = capacity ? capacity * 2 : 64;
+        arr = (T*)realloc(arr, sizeof(T) * capacity);
+
+        if(!arr)
+            CRASH("Out of memory\n");
+    }
+
+    arr[count++] = value;
+}
+
+inline static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline static void SkipSpaces(const char*& p, const char* end)
+{
+    while(p < end && IsSpace(*p))
+        p += 1;
+}
+
+inline static void SkipLine(const char*& p, const char* end)
+{
+    while(p < end && *p != '\n')
+        p += 1;
+
+    if(p < end)
+        p += 1;
+}
+
+// Locale independent float parsing (fscanf/strtod honour the decimal
+// separator of the current locale)
+static bool ParseFloat(const char*& p, const char* end, float& value)
+{
+    SkipSpaces(p, end);
+
+    const char* start = p;
+
+    bool negative = false;
+
+    if(p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p += 1;
+    }
+
+    double mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+
+    while(p < end && *p >= '0' && *p <= '9')
+    {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits = true;
+        p += 1;
+    }
+
+    if(p < end && *p == '.')
+    {
+        p += 1;
+
+        while(p < end && *p >= '0' && *p <= '9')
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            exponent -= 1;
+            digits = true;
+            p += 1;
+        }
+    }
+
+    if(!digits)
+    {
+        p = start;
+        return false;
+    }
+
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* e = p + 1;
+        bool negativeExp = false;
+
+        if(e < end && (*e == '-' || *e == '+'))
+        {
+            negativeExp = *e == '-';
+            e += 1;
+        }
+
+        if(e < end && *e >= '0' && *e <= '9')
+        {
+            int exp = 0;
+
+            while(e < end && *e >= '0' && *e <= '9')
+            {
+                exp = exp * 10 + (*e - '0');
+                e += 1;
+            }
+
+            exponent += negativeExp ? -exp : exp;
+            p = e;
+        }
+    }
+
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+
+    double scale = 1;
+    int absExp = exponent < 0 ? -exponent : exponent;
+
+    while(absExp > 15)
+    {
+        scale *= 1e15;
+        absExp -= 15;
+    }
+
+    scale *= powers[absExp];
+
+    double result = exponent < 0 ? mantissa / scale : mantissa * scale;
+
+    value = (float)(negative ? -result : result);
+    return true;
+}
+
+static bool ParseInt(const char*& p, const char* end, int& value)
+{
+    bool negative = false;
+
+    if(p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p += 1;
+    }
+
+    if(p >= end || *p < '0' || *p > '9')
+        return false;
+
+    int result = 0;
+
+    while(p < end && *p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (*p - '0');
+        p += 1;
+    }
+
+    value = negative ? -result : result;
+    return true;
+}
+
+// Maps (position, texCoord) index pairs to vertices that were already
+// emitted so that shared face corners share a vertex
+struct VertexMap
+{
+    struct Slot
+    {
+        int pos, texCoord;
+        int vertex;             // -1 if the slot is empty
+    };
+
+    int capacity = 0, count = 0;
+    Slot* slots = nullptr;
+};
+
+inline static uint32_t HashVertexKey(int pos, int texCoord)
+{
+    uint32_t h = (uint32_t)pos * 0x9E3779B1u;
+    h ^= (uint32_t)texCoord * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0xC2B2AE3Du;
+    h ^= h >> 13;
+
+    return h;
+}
+
+static void ResizeVertexMap(VertexMap& map, int capacity)
+{
+    VertexMap::Slot* old = map.slots;
+    int oldCapacity = map.capacity;
+
+    map.slots = (VertexMap::Slot*)malloc(sizeof(VertexMap::Slot) * capacity);
+    map.capacity = capacity;
+
+    if(!map.slots)
+        CRASH("Out of memory\n");
+
+    for(int i = 0; i < capacity; ++i)
+        map.slots[i].vertex = -1;
 
-	GLuint id = CreateTexture(GL_RGBA, GL_RGBA, data, width, height);
+    for(int i = 0; i < oldCapacity; ++i)
+    {
+        if(old[i].vertex < 0) continue;
 
-	stbi_image_free(data);
+        uint32_t j = HashVertexKey(old[i].pos, old[i].texCoord) & (capacity - 1);
 
-    Texture texture;
+        while(map.slots[j].vertex >= 0)
+            j = (j + 1) & (capacity - 1);
 
-    texture.id = id;
-    texture.width = width;
-    texture.height = height;
+        map.slots[j] = old[i];
+    }
 
-    return texture;
+    free(old);
 }
 
-static GLuint CreateShaderProgram(const char* vertexSource, const char* fragmentSource)
-{ 
-	GLuint vertexShader, fragmentShader;
-	
-	vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+// Returns the slot for the given key (which is empty if the key isn't present)
+static VertexMap::Slot& FindVertex(VertexMap& map, int pos, int texCoord)
+{
+    // Keep the load factor under one half
+    if((map.count + 1) * 2 > map.capacity)
+        ResizeVertexMap(map, map.capacity ? map.capacity * 2 : 256);
 
-	glShaderSource(vertexShader, 1, &vertexSource, NULL);
-	glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+    uint32_t i = HashVertexKey(pos, texCoord) & (map.capacity - 1);
 
-	glCompileShader(vertexShader);
-	glCompileShader(fragmentShader);
+    while(map.slots[i].vertex >= 0)
+    {
+        if(map.slots[i].pos == pos && map.slots[i].texCoord == texCoord)
+            break;
 
-	GLint success = 0;
+        i = (i + 1) & (map.capacity - 1);
+    }
 
-	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-	
-	static char log[2048];
+    return map.slots[i];
+}
 
-	if (success == GL_FALSE)
-	{
-		glGetShaderInfoLog(vertexShader, sizeof(log), NULL, log);
-		CRASH("Vertex shader compilation failed: %s\n", log);
-	}
+// Single pass over the mapped file. Supports v, vt and f (with any number
+// of corners, which get fan triangulated). Normals are ignored.
+// No static state so it can run on any thread.
+static MeshData LoadObjMeshData(const char* filename)
+{
+    AssetFile file;
 
-	glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    if(!TryOpenAsset(filename, file))
+        CRASH("Failed to open mesh file '%s'\n", filename);
 
-	if (success == GL_FALSE)
-	{
-		glGetShaderInfoLog(fragmentShader, sizeof(log), NULL, log);
-		CRASH("Fragment shader compilation failed: %s\n", log);
-	}
+    struct Position { float x, y, z; };
+    struct TexCoord { float u, v; };
 
-	GLuint program = glCreateProgram();
+    int posCount = 0, posCapacity = 0;
+    Position* positions = nullptr;
 
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
+    int texCoordCount = 0, texCoordCapacity = 0;
+    TexCoord* texCoords = nullptr;
 
-	glLinkProgram(program);
+    int vertexCount = 0, vertexCapacity = 0;
+    Vertex* vertices = nullptr;
 
-	glDetachShader(program, vertexShader);
-	glDetachShader(program, fragmentShader);
+    int indexCount = 0, indexCapacity = 0;
+    uint* indices = nullptr;
 
-	glGetProgramiv(program, GL_LINK_STATUS, &success);
-	
-	if (success == GL_FALSE)
-	{
-		glGetProgramInfoLog(program, sizeof(log), NULL, log);
-		CRASH("Shader program linking failed: %s\n", log);
-	}
+    VertexMap map;
 
-	return program;
-}
+    const char* p = (const char*)file.data;
+    const char* end = p + file.size;
 
-static char* ReadEntireFile(const char* filename)
-{
-    FILE* file = fopen(filename, "rb");
+    int line = 1;
 
-    if(!file)
-        CRASH("Failed to open file '%s' for reading\n", filename);
+    while(p < end)
+    {
+        SkipSpaces(p, end);
 
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
+        if(p + 1 < end && p[0] == 'v' && IsSpace(p[1]))
+        {
+            p += 1;
 
-    rewind(file);
+            Position pos;
 
-    char* str = (char*)malloc(size + 1);
-    
-    fread(str, 1, size, file);
-    str[size] = '\0';
+            if(!ParseFloat(p, end, pos.x) || !ParseFloat(p, end, pos.y) || !ParseFloat(p, end, pos.z))
+                CRASH("%s(%d): Invalid vertex position\n", filename, line);
 
-    fclose(file);
+            Push(positions, posCount, posCapacity, pos);
+        }
+        else if(p + 2 < end && p[0] == 'v' && p[1] == 't' && IsSpace(p[2]))
+        {
+            p += 2;
 
-    return str;
+            TexCoord texCoord;
+
+            if(!ParseFloat(p, end, texCoord.u) || !ParseFloat(p, end, texCoord.v))
+                CRASH("%s(%d): Invalid texture coordinate\n", filename, line);
+
+            Push(texCoords, texCoordCount, texCoordCapacity, texCoord);
+        }
+        else if(p + 1 < end && p[0] == 'f' && IsSpace(p[1]))
+        {
+            p += 1;
+
+            int first = -1, prev = -1;
+            int corner = 0;
+
+            while(true)
+            {
+                SkipSpaces(p, end);
+
+                if(p >= end || *p == '\n' || *p == '#')
+                    break;
+
+                int pos = 0, texCoord = 0, normal = 0;
+
+                if(!ParseInt(p, end, pos))
+                    CRASH("%s(%d): Invalid face\n", filename, line);
+
+                if(p < end && *p == '/')
+                {
+                    p += 1;
+                    ParseInt(p, end, texCoord);
+
+                    if(p < end && *p == '/')
+                    {
+                        p += 1;
+                        ParseInt(p, end, normal);
+                    }
+                }
+
+                // Negative indices are relative to the end of the list
+                if(pos < 0) pos += posCount + 1;
+                if(texCoord < 0) texCoord += texCoordCount + 1;
+
+                if(pos < 1 || pos > posCount || texCoord < 0 || texCoord > texCoordCount)
+                    CRASH("%s(%d): Face index out of range\n", filename, line);
+
+                VertexMap::Slot& slot = FindVertex(map, pos, texCoord);
+
+                if(slot.vertex < 0)
+                {
+                    const Position& position = positions[pos - 1];
+
+                    float u = 0, v = 0;
+
+                    if(texCoord > 0)
+                    {
+                        u = texCoords[texCoord - 1].u;
+
+                        // HACK: Blender exports 0, 0 as top left of texture
+                        // whereas OpenGL expects 0, 0, as bottom left
+                        v = 1 - texCoords[texCoord - 1].v;
+                    }
+
+                    slot.pos = pos;
+                    slot.texCoord = texCoord;
+                    slot.vertex = vertexCount;
+                    map.count += 1;
+
+                    Push(vertices, vertexCount, vertexCapacity, Vertex{ position.x, position.y, position.z, u, v });
+                }
+
+                int index = slot.vertex;
+
+                if(corner == 0)
+                    first = index;
+                else if(corner >= 2)
+                {
+                    Push(indices, indexCount, indexCapacity, (uint)first);
+                    Push(indices, indexCount, indexCapacity, (uint)prev);
+                    Push(indices, indexCount, indexCapacity, (uint)index);
+                }
+
+                prev = index;
+                corner += 1;
+            }
+
+            if(corner < 3)
+                CRASH("%s(%d): Face has fewer than 3 corners\n", filename, line);
+        }
+
+        SkipLine(p, end);
+        line += 1;
+    }
+
+    CloseAsset(file);
+
+    free(positions);
+    free(texCoords);
+    free(map.slots);
+
+    MeshData data;
+
+    data.vertexCount = vertexCount;
+    data.indexCount = indexCount;
+    data.vertices = vertices;
+
+    if(vertexCount > MAX_SHORT_INDEX_VERTICES)
+    {
+        data.indexSize = sizeof(uint);
+        data.indices = indices;
+    }
+    else
+    {
+        ushort* narrow = (ushort*)malloc(sizeof(ushort) * indexCount);
+
+        for(int i = 0; i < indexCount; ++i)
+            narrow[i] = (ushort)indices[i];
+
+        free(indices);
+
+        data.indexSize = sizeof(ushort);
+        data.indices = narrow;
+    }
+
+    return data;
 }
 
-Shader LoadShader(const char* vertexFilename, const char* fragmentFilename)
+static uint32_t AlignMeshOffset(uint32_t offset)
 {
-    char* vertexSource = ReadEntireFile(vertexFilename);
-    char* fragmentSource = ReadEntireFile(fragmentFilename);
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~(MESH_FILE_ALIGNMENT - 1);
+}
 
-    Shader shader;
+static MeshData LoadCompiledMeshData(const char* filename)
+{
+    MeshData data;
 
-    shader.id = CreateShaderProgram(vertexSource, fragmentSource);
+    data.asset = OpenAsset(filename);
 
-    free(vertexSource);
-    free(fragmentSource);
+    size_t size = data.asset.size;
 
-    return shader;
+    if(size < sizeof(MeshFileHeader))
+        CRASH("Mesh file '%s' is truncated\n", filename);
+
+    const MeshFileHeader* header = (const MeshFileHeader*)data.asset.data;
+
+    if(header->magic != MESH_FILE_MAGIC)
+        CRASH("'%s' is not a compiled mesh file\n", filename);
+
+    if(header->version != MESH_FILE_VERSION)
+        CRASH("Mesh file '%s' has version %u (expected %u)\n", filename, header->version, MESH_FILE_VERSION);
+
+    if(header->indexSize != sizeof(ushort) && header->indexSize != sizeof(uint))
+        CRASH("Mesh file '%s' uses %u byte indices which aren't supported\n", filename, header->indexSize);
+
+    if(header->vertexCount < 0 || header->vertexOffset + sizeof(Vertex) * header->vertexCount > size ||
+       header->indexCount < 0 || header->indexOffset + header->indexSize * header->indexCount > size)
+        CRASH("Mesh file '%s' has invalid vertex or index tables\n", filename);
+
+    data.vertexCount = header->vertexCount;
+    data.indexCount = header->indexCount;
+
+    data.vertices = (Vertex*)(data.asset.data + header->vertexOffset);
+    data.indexSize = header->indexSize;
+    data.indices = (void*)(data.asset.data + header->indexOffset);
+
+    return data;
 }
 
-Mesh LoadMesh(const char* filename)
+MeshData LoadMeshData(const char* filename)
 {
-    // x,y,z per vertex
-    static float positions[MAX_LOAD_MESH_VERTICES][3];
-    // u,v per vertex
-    static float texCoords[MAX_LOAD_MESH_VERTICES][2];
+    const char* ext = strrchr(filename, '.');
 
-    static ushort indices[MAX_LOAD_MESH_VERTICES];
-    static Vertex vertices[MAX_LOAD_MESH_VERTICES];
+    if(ext && strcmp(ext, ".msh") == 0)
+        return LoadCompiledMeshData(filename);
 
-    const char* ext = strrchr(filename, '.');
-    
-    // Only supports obj files
+    // Only supports obj files otherwise
     assert(ext && strcmp(ext, ".obj") == 0); 
 
-    FILE* file = fopen(filename, "rb");
+    return LoadObjMeshData(filename);
+}
+
+void SaveMeshData(const MeshData& data, const char* filename)
+{
+    static const unsigned char padding[MESH_FILE_ALIGNMENT] = {0};
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+
+    header.vertexCount = data.vertexCount;
+    header.vertexOffset = AlignMeshOffset(sizeof(header));
+
+    header.indexCount = data.indexCount;
+    header.indexOffset = AlignMeshOffset(header.vertexOffset + sizeof(Vertex) * data.vertexCount);
+    header.indexSize = data.indexSize;
+
+    FILE* file = fopen(filename, "wb");
 
     if(!file)
-        CRASH("Failed to open mesh file '%s'\n", filename);
+        CRASH("Failed to open mesh file '%s' for writing\n", filename);
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(padding, 1, header.vertexOffset - sizeof(header), file);
+
+    fwrite(data.vertices, sizeof(Vertex), data.vertexCount, file);
+    fwrite(padding, 1, header.indexOffset - (header.vertexOffset + sizeof(Vertex) * data.vertexCount), file);
 
-    int posCount = 0;
-    int texCoordCount = 0;
+    fwrite(data.indices, data.indexSize, data.indexCount, file);
 
-    // TODO: Intelligent generation of indices
-    // Right now we're basically not using index
-    // buffer at all so indexCount == vertexCount
-    int vertexCount = 0;
+    fclose(file);
+}
 
-    while(true)
+void DestroyMeshData(MeshData& data)
+{
+    if(data.asset.data)
+        CloseAsset(data.asset);
+    else
     {
-        static char lineHeader[128];
+        free(data.vertices);
+        free(data.indices);
+    }
 
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-            break;
+    data = MeshData();
+}
 
-        if (strcmp(lineHeader, "v") == 0)
-        {
-            float pos[3];
+Mesh CreateMesh(const MeshData& data)
+{
+    if(data.indexSize == sizeof(uint))
+        return CreateMesh(data.vertexCount, data.vertices, data.indexCount, (const uint*)data.indices);
 
-            fscanf(file, "%f %f %f\n", &pos[0], &pos[1], &pos[2]);
+    return CreateMesh(data.vertexCount, data.vertices, data.indexCount, (const ushort*)data.indices);
+}
 
-            memcpy(positions[posCount++], pos, sizeof(pos));
-        }
-        else if (strcmp(lineHeader, "vt") == 0)
-        {
-            float texCoord[2];
+Mesh LoadMesh(const char* filename)
+{
+    MeshData data = LoadMeshData(filename);
 
-            fscanf(file, "%f %f\n", &texCoord[0], &texCoord[1]);
-            memcpy(texCoords[texCoordCount++], texCoord, sizeof(texCoord)); 
-        }
-        else if (strcmp(lineHeader, "f") == 0)
-        {
-            int pos[3], texCoord[3];
-            
-            fscanf(file, "%d/%d %d/%d %d/%d\n",
-                &pos[0], &texCoord[0],
-                &pos[1], &texCoord[1],
-                &pos[2], &texCoord[2]);
-
-            for (int i = 0; i < 3; ++i)
-            {
-                float x = positions[pos[i] - 1][0];
-                float y = positions[pos[i] - 1][1];
-                float z = positions[pos[i] - 1][2];
-                float u = texCoords[texCoord[i] - 1][0];
-                float v = texCoords[texCoord[i] - 1][1];
-            
-                if(vertexCount >= MAX_LOAD_MESH_VERTICES)
-                    CRASH("Model exceeded maximum number of vertices\n");
-
-                // HACK: Blender exports 0, 0 as top left of texture
-                // whereas OpenGL expects 0, 0, as bottom left
-                v = 1 - v;
-            
-                indices[vertexCount] = vertexCount;
-                vertices[vertexCount] = { x, y, z, u, v };
-
-                vertexCount += 1;
-            }
-        }
-    }
+    Mesh mesh = CreateMesh(data);
 
-    fclose(file);
+    DestroyMeshData(data);
 
-    // TODO: Change vertexCount to indexCount once that's changed
-    return CreateMesh(vertexCount, vertices, vertexCount, indices);
+    return mesh;
 }
 
 Font LoadFont(const char* filename, float height)
 {
-    FILE* file = fopen(filename, "rb");
+    AssetFile file;
 
-    if(!file)
+    if(!TryOpenAsset(filename, file))
         CRASH("Failed to open bitmap font file '%s'\n", filename);
 
-    fread(FontDataBuffer, 1, 1 << 20, file);
-    fclose(file);
+    if(file.size > sizeof(FontDataBuffer))
+        CRASH("Font file '%s' is too large\n", filename);
+
+    // stbtt keeps pointing at the font data, so it has to outlive the asset
+    memcpy(FontDataBuffer, file.data, file.size);
+    CloseAsset(file);
 
     Font font;
 
@@ -251,30 +1252,64 @@ Font LoadFont(const char* filename, float height)
     return font;
 }
 
-Level LoadLevel(const char* filename)
+struct TextReader
 {
-    FILE* file = fopen(filename, "r");
+    const char* filename;
+    const char* start;
+    const char* p;
+    const char* end;
+};
 
-    if(!file)
+inline static void SkipWhitespace(TextReader& reader)
+{
+    while(reader.p < reader.end && (IsSpace(*reader.p) || *reader.p == '\n'))
+        reader.p += 1;
+}
+
+static void Read(TextReader& reader, int& value)
+{
+    SkipWhitespace(reader);
+
+    if(!ParseInt(reader.p, reader.end, value))
+        CRASH("Expected an integer in '%s' at offset %d\n", reader.filename, (int)(reader.p - reader.start));
+}
+
+static void Read(TextReader& reader, float& value)
+{
+    SkipWhitespace(reader);
+
+    if(!ParseFloat(reader.p, reader.end, value))
+        CRASH("Expected a number in '%s' at offset %d\n", reader.filename, (int)(reader.p - reader.start));
+}
+
+static Level LoadTextLevel(const char* filename)
+{
+    AssetFile file;
+
+    if(!TryOpenAsset(filename, file))
         CRASH("Failed to open level file '%s'\n", filename);
 
+    TextReader reader = { filename, (const char*)file.data, (const char*)file.data, (const char*)file.data + file.size };
+
     Level level;
 
-    fscanf(file, "%d", &level.planeCount);
+    Read(reader, level.planeCount);
 
     level.planes = (Level::Plane*)malloc(sizeof(Level::Plane) * level.planeCount);
 
     for(int i = 0; i < level.planeCount; ++i)
     {
         Level::Plane& plane = level.planes[i];
-        fscanf(file, "%d %d %d %d %d %d %d %d %d %d", &plane.o[0], &plane.o[1], &plane.o[2],
-                                                      &plane.a[0], &plane.a[1], &plane.a[2],
-                                                      &plane.b[0], &plane.b[1], &plane.b[2],
-                                                      &plane.tile);
+
+        for(int j = 0; j < 3; ++j) Read(reader, plane.o[j]);
+        for(int j = 0; j < 3; ++j) Read(reader, plane.a[j]);
+        for(int j = 0; j < 3; ++j) Read(reader, plane.b[j]);
+
+        Read(reader, plane.tile);
     }
 
     for(int i = 0; i < ET_COUNT; ++i)
-        fscanf(file, "%d", &level.entityCount[i]);
+        Read(reader, level.entityCount[i]);
 
     for(int i = 0; i < ET_COUNT; ++i)
     { 
@@ -287,36 +1322,248 @@ Level LoadLevel(const char* filename)
             info.type = (EntityType)i;
 				
             // Always present
-            fscanf(file, "%f %f %f", &info.x, &info.y, &info.z);
+            Read(reader, info.x);
+            Read(reader, info.y);
+            Read(reader, info.z);
 
             switch(info.type)
             {
                 case ET_DOOR:
                 case ET_PAINTING:
                 {
-                    fscanf(file, "%d", &info.dir);
+                    Read(reader, info.dir);
                 } break;
 
                 case ET_ENEMY:
                 {
-                    fscanf(file, "%d", &info.health);
-                    fscanf(file, "%f", &info.speed);
+                    Read(reader, info.health);
+                    Read(reader, info.speed);
                 } break;
 
                 case ET_BOXCOLLIDER:
                 {
-                    fscanf(file, "%f %f %f %f %f %f", &info.minx, &info.miny, &info.minz,
-                                                      &info.maxx, &info.maxy, &info.maxz);
+                    Read(reader, info.minx);
+                    Read(reader, info.miny);
+                    Read(reader, info.minz);
+                    Read(reader, info.maxx);
+                    Read(reader, info.maxy);
+                    Read(reader, info.maxz);
                 } break;
+
+                default: break;
             }
         }
     }
 
-    fclose(file);
+    CloseAsset(file);
+
+    return level;
+}
+
+static uint32_t AlignLevelOffset(uint32_t offset)
+{
+    return (offset + LEVEL_FILE_ALIGNMENT - 1) & ~(LEVEL_FILE_ALIGNMENT - 1);
+}
+
+static Level LoadCompiledLevel(const char* filename)
+{
+    Level level;
+
+    level.asset = OpenAsset(filename);
+
+    const unsigned char* data = level.asset.data;
+    size_t size = level.asset.size;
+
+    if(size < sizeof(LevelFileHeader))
+        CRASH("Level file '%s' is truncated\n", filename);
+
+    const LevelFileHeader* header = (const LevelFileHeader*)data;
+
+    if(header->magic != LEVEL_FILE_MAGIC)
+        CRASH("'%s' is not a compiled level file\n", filename);
+
+    if(header->version != LEVEL_FILE_VERSION)
+        CRASH("Level file '%s' has version %u (expected %u)\n", filename, header->version, LEVEL_FILE_VERSION);
+
+    if(header->planeCount < 0 || header->planeOffset + sizeof(Level::Plane) * header->planeCount > size)
+        CRASH("Level file '%s' has an invalid plane table\n", filename);
+
+    level.planeCount = header->planeCount;
+    level.planes = (Level::Plane*)(data + header->planeOffset);
+
+    for(int i = 0; i < ET_COUNT; ++i)
+    {
+        if(header->entityCount[i] < 0 || header->entityOffset[i] + sizeof(EntityInfo) * header->entityCount[i] > size)
+            CRASH("Level file '%s' has an invalid entity table\n", filename);
+
+        level.entityCount[i] = header->entityCount[i];
+        level.entities[i] = (EntityInfo*)(data + header->entityOffset[i]);
+    }
+
+    if(header->areaCount > 0)
+    {
+        size_t cellCount = (size_t)header->gridWidth * header->gridHeight;
+        size_t pvsSize = (size_t)header->areaCount * LEVEL_PVS_ROW_SIZE(header->areaCount);
+
+        if(header->gridWidth < 0 || header->gridHeight < 0 || header->portalCount < 0 ||
+           header->cellOffset + sizeof(int16_t) * cellCount > size ||
+           header->pvsOffset + pvsSize > size ||
+           header->portalOffset + sizeof(LevelPortal) * header->portalCount > size)
+            CRASH("Level file '%s' has invalid visibility tables\n", filename);
+
+        level.gridX = header->gridX;
+        level.gridZ = header->gridZ;
+        level.gridWidth = header->gridWidth;
+        level.gridHeight = header->gridHeight;
+        level.cellAreas = (int16_t*)(data + header->cellOffset);
+
+        level.areaCount = header->areaCount;
+        level.pvs = (uint8_t*)(data + header->pvsOffset);
+
+        level.portalCount = header->portalCount;
+        level.portals = (LevelPortal*)(data + header->portalOffset);
+    }
 
     return level;
 }
 
+Level LoadLevel(const char* filename)
+{
+    const char* ext = strrchr(filename, '.');
+
+    if(ext && strcmp(ext, ".lvl") == 0)
+        return LoadCompiledLevel(filename);
+
+    return LoadTextLevel(filename);
+}
+
+void SaveLevel(const Level& level, const char* filename)
+{
+    static const unsigned char padding[LEVEL_FILE_ALIGNMENT] = {0};
+
+    LevelFileHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.magic = LEVEL_FILE_MAGIC;
+    header.version = LEVEL_FILE_VERSION;
+
+    uint32_t offset = AlignLevelOffset(sizeof(header));
+
+    header.planeCount = level.planeCount;
+    header.planeOffset = offset;
+
+    offset = AlignLevelOffset(offset + sizeof(Level::Plane) * level.planeCount);
+
+    for(int i = 0; i < ET_COUNT; ++i)
+    {
+        header.entityCount[i] = level.entityCount[i];
+        header.entityOffset[i] = offset;
+
+        offset = AlignLevelOffset(offset + sizeof(EntityInfo) * level.entityCount[i]);
+    }
+
+    size_t cellCount = (size_t)level.gridWidth * level.gridHeight;
+    size_t pvsSize = (size_t)level.areaCount * LEVEL_PVS_ROW_SIZE(level.areaCount);
+
+    if(level.areaCount > 0)
+    {
+        header.gridX = level.gridX;
+        header.gridZ = level.gridZ;
+        header.gridWidth = level.gridWidth;
+        header.gridHeight = level.gridHeight;
+        header.cellOffset = offset;
+
+        offset = AlignLevelOffset(offset + sizeof(int16_t) * cellCount);
+
+        header.areaCount = level.areaCount;
+        header.pvsOffset = offset;
+
+        offset = AlignLevelOffset(offset + pvsSize);
+
+        header.portalCount = level.portalCount;
+        header.portalOffset = offset;
+    }
+
+    FILE* file = fopen(filename, "wb");
+
+    if(!file)
+        CRASH("Failed to open level file '%s' for writing\n", filename);
+
+    fwrite(&header, sizeof(header), 1, file);
+
+    uint32_t written = sizeof(header);
+
+    // Pads the file up to the next table
+    auto seekTo = [&](uint32_t target) {
+        fwrite(padding, 1, target - written, file);
+        written = target;
+    };
+
+    seekTo(header.planeOffset);
+    fwrite(level.planes, sizeof(Level::Plane), level.planeCount, file);
+    written += sizeof(Level::Plane) * level.planeCount;
+
+    for(int i = 0; i < ET_COUNT; ++i)
+    {
+        seekTo(header.entityOffset[i]);
+
+        // Make sure the unused union members don't carry garbage into the file
+        for(int j = 0; j < level.entityCount[i]; ++j)
+        {
+            EntityInfo info;
+            memset(&info, 0, sizeof(info));
+
+            const EntityInfo& src = level.entities[i][j];
+
+            info.type = src.type;
+            info.x = src.x;
+            info.y = src.y;
+            info.z = src.z;
+
+            switch(src.type)
+            {
+                case ET_DOOR:
+                case ET_PAINTING:
+                    info.dir = src.dir;
+                    break;
+
+                case ET_ENEMY:
+                    info.health = src.health;
+                    info.speed = src.speed;
+                    break;
+
+                case ET_BOXCOLLIDER:
+                    info.minx = src.minx; info.miny = src.miny; info.minz = src.minz;
+                    info.maxx = src.maxx; info.maxy = src.maxy; info.maxz = src.maxz;
+                    break;
+
+                default: break;
+            }
+
+            fwrite(&info, sizeof(info), 1, file);
+        }
+
+        written += sizeof(EntityInfo) * level.entityCount[i];
+    }
+
+    if(level.areaCount > 0)
+    {
+        seekTo(header.cellOffset);
+        fwrite(level.cellAreas, sizeof(int16_t), cellCount, file);
+        written += sizeof(int16_t) * cellCount;
+
+        seekTo(header.pvsOffset);
+        fwrite(level.pvs, 1, pvsSize, file);
+        written += pvsSize;
+
+        seekTo(header.portalOffset);
+        fwrite(level.portals, sizeof(LevelPortal), level.portalCount, file);
+        written += sizeof(LevelPortal) * level.portalCount;
+    }
+
+    fclose(file);
+}
+
 void DestroyFont(Font& font)
 {
     // TODO: Destroy Texture
@@ -324,8 +1571,19 @@ void DestroyFont(Font& font)
 
 void DestroyLevel(Level& level)
 {
+    if(level.asset.data)
+    {
+        // Everything points into the asset
+        CloseAsset(level.asset);
+        return;
+    }
+
     free(level.planes);
 
     for(int i = 0; i < ET_COUNT; ++i)
         free(level.entities[i]);
+
+    free(level.cellAreas);
+    free(level.pvs);
+    free(level.portals);
 }
@@ -0,0 +1,212 @@
+#include <string.h>
+
+#include "stream.hpp"
+#include "glstate.hpp"
+#include "utils.hpp"
+
+static struct
+{
+    GLuint buffer = 0;
+
+    bool persistent = false;
+    // The whole buffer when it's persistently mapped
+    unsigned char* mapped = nullptr;
+
+    size_t regionSize = 0;
+
+    int region = 0;
+    // Offset into the buffer of the first free byte in the region
+    size_t head = 0;
+
+    GLsync fences[STREAM_REGIONS] = {};
+
+    StreamStats stats;
+} Ring;
+
+static bool SupportsBufferStorage()
+{
+    if(!glBufferStorage)
+        return false;
+
+    GLint major = 0, minor = 0;
+
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+    if(major > 4 || (major == 4 && minor >= 4))
+        return true;
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+    for(int i = 0; i < count; ++i)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+
+        if(name && strcmp(name, "GL_ARB_buffer_storage") == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static size_t GetRegionStart(int region)
+{
+    return (size_t)region * Ring.regionSize;
+}
+
+static size_t AlignUp(size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Fences the current region and moves on to the next one
+static void NextRegion()
+{
+    Ring.fences[Ring.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    Ring.region = (Ring.region + 1) % STREAM_REGIONS;
+    Ring.head = GetRegionStart(Ring.region);
+
+    GLsync fence = Ring.fences[Ring.region];
+
+    if(!fence)
+        return;
+
+    if(glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        Ring.stats.stalls += 1;
+
+        while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            continue;
+    }
+
+    glDeleteSync(fence);
+    Ring.fences[Ring.region] = 0;
+}
+
+void InitStream(size_t regionSize)
+{
+    Ring.regionSize = regionSize;
+    Ring.persistent = SupportsBufferStorage();
+
+    size_t size = regionSize * STREAM_REGIONS;
+
+    glGenBuffers(1, &Ring.buffer);
+    BindArrayBuffer(Ring.buffer);
+
+    if(Ring.persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        Ring.mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+
+        if(!Ring.mapped)
+            CRASH("Failed to map the stream buffer\n");
+    }
+    else
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+    Ring.region = 0;
+    Ring.head = 0;
+
+    Ring.stats = StreamStats();
+    Ring.stats.persistent = Ring.persistent;
+}
+
+GLuint GetStreamBuffer()
+{
+    return Ring.buffer;
+}
+
+void* MapStream(size_t size, size_t alignment, size_t& offset)
+{
+    if(size > Ring.regionSize)
+        CRASH("Stream allocation of %zu bytes is bigger than a region (%zu)\n", size, Ring.regionSize);
+
+    offset = AlignUp(Ring.head, alignment);
+
+    if(offset + size > GetRegionStart(Ring.region) + Ring.regionSize)
+    {
+        NextRegion();
+        offset = AlignUp(Ring.head, alignment);
+
+        // The alignment padding can push a region-sized allocation over
+        if(offset + size > GetRegionStart(Ring.region) + Ring.regionSize)
+            CRASH("Stream allocation of %zu bytes doesn't fit in a region\n", size);
+    }
+
+    Ring.head = offset + size;
+    Ring.stats.bytesThisFrame += size;
+
+    if(Ring.persistent)
+        return Ring.mapped + offset;
+
+    BindArrayBuffer(Ring.buffer);
+
+    void* data = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, 
+                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+
+    if(!data)
+        CRASH("Failed to map %zu bytes of the stream buffer\n", size);
+
+    return data;
+}
+
+void UnmapStream()
+{
+    // Coherent, nothing to flush
+    if(Ring.persistent)
+        return;
+
+    BindArrayBuffer(Ring.buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+size_t Stream(const void* data, size_t size, size_t alignment)
+{
+    size_t offset;
+
+    memcpy(MapStream(size, alignment, offset), data, size);
+    UnmapStream();
+
+    return offset;
+}
+
+void EndStreamFrame()
+{
+    Ring.stats.bytesLastFrame = Ring.stats.bytesThisFrame;
+    Ring.stats.bytesThisFrame = 0;
+
+    NextRegion();
+}
+
+StreamStats GetStreamStats()
+{
+    return Ring.stats;
+}
+
+void DestroyStream()
+{
+    for(int i = 0; i < STREAM_REGIONS; ++i)
+    {
+        if(Ring.fences[i])
+            glDeleteSync(Ring.fences[i]);
+
+        Ring.fences[i] = 0;
+    }
+
+    if(Ring.persistent)
+    {
+        BindArrayBuffer(Ring.buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    glDeleteBuffers(1, &Ring.buffer);
+
+    Ring.buffer = 0;
+    Ring.mapped = nullptr;
+
+    InvalidateGLState();
+}
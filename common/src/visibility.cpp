@@ -0,0 +1,740 @@
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "visibility.hpp"
+#include "utils.hpp"
+
+// Planes are in half-grid coordinates, so a cell is this many across
+static const int CELL_HALF_UNITS = 2;
+
+// Cell states used while baking, before areas are assigned
+static const int16_t CELL_SOLID = -1;
+static const int16_t CELL_OPEN = -2;
+static const int16_t CELL_DOOR = -3;
+
+static int FloorDiv(int x, int d)
+{
+    int q = x / d;
+
+    if((x % d != 0) && ((x < 0) != (d < 0)))
+        --q;
+
+    return q;
+}
+
+static int16_t GetCell(const Level& level, int x, int z)
+{
+    x -= level.gridX;
+    z -= level.gridZ;
+
+    if(x < 0 || z < 0 || x >= level.gridWidth || z >= level.gridHeight)
+        return CELL_SOLID;
+
+    return level.cellAreas[z * level.gridWidth + x];
+}
+
+static void SetCell(Level& level, int x, int z, int16_t value)
+{
+    level.cellAreas[(z - level.gridZ) * level.gridWidth + (x - level.gridX)] = value;
+}
+
+static void GetPortalCell(const Level& level, const LevelPortal& portal, int& x, int& z)
+{
+    const EntityInfo& info = level.entities[ET_DOOR][portal.door];
+
+    x = (int)floorf(info.x / LEVEL_SCALE_FACTOR);
+    z = (int)floorf(info.z / LEVEL_SCALE_FACTOR);
+}
+
+static void SetVisible(Level& level, int from, int to)
+{
+    level.pvs[from * LEVEL_PVS_ROW_SIZE(level.areaCount) + to / 8] |= (uint8_t)(1 << (to % 8));
+}
+
+// Returns the area on the other side of the portal, -1 if there's nothing there
+static int GetOtherSide(const LevelPortal& portal, int area)
+{
+    if(portal.areas[0] == area)
+        return portal.areas[1] == area ? -1 : portal.areas[1];
+
+    if(portal.areas[1] == area)
+        return portal.areas[0];
+
+    return -1;
+}
+
+static bool IsAdjacent(const LevelPortal& portal, int area)
+{
+    return portal.areas[0] == area || portal.areas[1] == area;
+}
+
+// Walks every cell the segment (in cell units) passes through and
+// returns false if any of them is solid. Lines going exactly through a
+// corner squeeze past diagonally, which errs on the side of visible.
+static bool IsLineOpen(const Level& level, float x0, float z0, float x1, float z1)
+{
+    int x = (int)floorf(x0);
+    int z = (int)floorf(z0);
+
+    int endX = (int)floorf(x1);
+    int endZ = (int)floorf(z1);
+
+    float dx = x1 - x0;
+    float dz = z1 - z0;
+
+    int stepX = dx > 0 ? 1 : -1;
+    int stepZ = dz > 0 ? 1 : -1;
+
+    float deltaX = dx != 0 ? fabsf(1 / dx) : INFINITY;
+    float deltaZ = dz != 0 ? fabsf(1 / dz) : INFINITY;
+
+    float nextX = dx != 0 ? (stepX > 0 ? x + 1 - x0 : x0 - x) * deltaX : INFINITY;
+    float nextZ = dz != 0 ? (stepZ > 0 ? z + 1 - z0 : z0 - z) * deltaZ : INFINITY;
+
+    int steps = abs(endX - x) + abs(endZ - z);
+
+    for(int i = 0; ; ++i)
+    {
+        if(GetCell(level, x, z) < 0)
+            return false;
+
+        if((x == endX && z == endZ) || i >= steps)
+            return true;
+
+        if(nextX < nextZ)
+        {
+            x += stepX;
+            nextX += deltaX;
+        }
+        else if(nextZ < nextX)
+        {
+            z += stepZ;
+            nextZ += deltaZ;
+        }
+        else
+        {
+            x += stepX;
+            z += stepZ;
+            nextX += deltaX;
+            nextZ += deltaZ;
+        }
+    }
+}
+
+// True if any of a handful of lines between the two portal cells is clear
+static bool IsPortalVisible(const Level& level, const LevelPortal& a, const LevelPortal& b)
+{
+    static const float SAMPLES[] = { 0.05f, 0.5f, 0.95f };
+
+    int ax, az, bx, bz;
+
+    GetPortalCell(level, a, ax, az);
+    GetPortalCell(level, b, bx, bz);
+
+    if(ax == bx && az == bz)
+        return true;
+
+    for(size_t i = 0; i < COUNT_OF(SAMPLES); ++i)
+    for(size_t j = 0; j < COUNT_OF(SAMPLES); ++j)
+    for(size_t k = 0; k < COUNT_OF(SAMPLES); ++k)
+    for(size_t l = 0; l < COUNT_OF(SAMPLES); ++l)
+    {
+        if(IsLineOpen(level, ax + SAMPLES[i], az + SAMPLES[j], bx + SAMPLES[k], bz + SAMPLES[l]))
+            return true;
+    }
+
+    return false;
+}
+
+struct PortalFlow
+{
+    int source;
+
+    int chain[LEVEL_MAX_PORTAL_CHAIN];
+    bool* onPath;
+
+    // Memoized IsPortalVisible results (-1 if not computed yet)
+    int8_t* portalVisible;
+};
+
+static bool IsPortalVisible(const Level& level, PortalFlow& flow, int a, int b)
+{
+    int8_t& result = flow.portalVisible[a * level.portalCount + b];
+
+    if(result < 0)
+    {
+        result = IsPortalVisible(level, level.portals[a], level.portals[b]) ? 1 : 0;
+        flow.portalVisible[b * level.portalCount + a] = result;
+    }
+
+    return result != 0;
+}
+
+// Floods out of the source area through the chain of portals so far into
+// room. A portal beyond that is only followed if there's a line of sight
+// to it from both the first and the last portal of the chain.
+static void Flow(Level& level, PortalFlow& flow, int depth, int room)
+{
+    SetVisible(level, flow.source, room);
+
+    if(depth >= LEVEL_MAX_PORTAL_CHAIN)
+        return;
+
+    flow.onPath[room] = true;
+
+    for(int i = 0; i < level.portalCount; ++i)
+    {
+        const LevelPortal& portal = level.portals[i];
+
+        if(!IsAdjacent(portal, room))
+            continue;
+
+        bool inChain = false;
+
+        for(int j = 0; j < depth; ++j)
+            inChain = inChain || flow.chain[j] == i;
+
+        if(inChain)
+            continue;
+
+        if(!IsPortalVisible(level, flow, flow.chain[0], i) ||
+           !IsPortalVisible(level, flow, flow.chain[depth - 1], i))
+            continue;
+
+        SetVisible(level, flow.source, portal.area);
+
+        int next = GetOtherSide(portal, room);
+
+        if(next >= 0 && !flow.onPath[next])
+        {
+            flow.chain[depth] = i;
+            Flow(level, flow, depth + 1, next);
+        }
+    }
+
+    flow.onPath[room] = false;
+}
+
+void BakeLevelVisibility(Level& level)
+{
+    free(level.cellAreas);
+    free(level.pvs);
+    free(level.portals);
+
+    level.cellAreas = nullptr;
+    level.pvs = nullptr;
+    level.portals = nullptr;
+
+    level.gridX = level.gridZ = 0;
+    level.gridWidth = level.gridHeight = 0;
+    level.areaCount = 0;
+    level.portalCount = 0;
+
+    // Every cell with a floor (or ceiling) is open
+    bool anyOpen = false;
+    int minX = 0, minZ = 0, maxX = 0, maxZ = 0;
+
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        for(int i = 0; i < level.planeCount; ++i)
+        {
+            const Level::Plane& plane = level.planes[i];
+
+            if(plane.a[1] != 0 || plane.b[1] != 0)
+                continue;
+
+            int x1 = plane.o[0], x2 = plane.o[0] + plane.a[0] + plane.b[0];
+            int z1 = plane.o[2], z2 = plane.o[2] + plane.a[2] + plane.b[2];
+
+            if(x1 > x2) std::swap(x1, x2);
+            if(z1 > z2) std::swap(z1, z2);
+
+            int cx1 = FloorDiv(x1, CELL_HALF_UNITS), cx2 = FloorDiv(x2 - 1, CELL_HALF_UNITS);
+            int cz1 = FloorDiv(z1, CELL_HALF_UNITS), cz2 = FloorDiv(z2 - 1, CELL_HALF_UNITS);
+
+            if(pass == 0)
+            {
+                if(!anyOpen)
+                {
+                    minX = cx1; maxX = cx2;
+                    minZ = cz1; maxZ = cz2;
+
+                    anyOpen = true;
+                }
+
+                minX = std::min(minX, cx1); maxX = std::max(maxX, cx2);
+                minZ = std::min(minZ, cz1); maxZ = std::max(maxZ, cz2);
+
+                continue;
+            }
+
+            for(int z = cz1; z <= cz2; ++z)
+            {
+                for(int x = cx1; x <= cx2; ++x)
+                    SetCell(level, x, z, CELL_OPEN);
+            }
+        }
+
+        if(!anyOpen)
+            return;
+
+        if(pass == 0)
+        {
+            level.gridX = minX;
+            level.gridZ = minZ;
+            level.gridWidth = maxX - minX + 1;
+            level.gridHeight = maxZ - minZ + 1;
+
+            int cellCount = level.gridWidth * level.gridHeight;
+
+            level.cellAreas = (int16_t*)malloc(sizeof(int16_t) * cellCount);
+
+            for(int i = 0; i < cellCount; ++i)
+                level.cellAreas[i] = CELL_SOLID;
+        }
+    }
+
+    int doorCount = level.entityCount[ET_DOOR];
+
+    level.portals = (LevelPortal*)malloc(sizeof(LevelPortal) * (doorCount > 0 ? doorCount : 1));
+
+    for(int i = 0; i < doorCount; ++i)
+    {
+        const EntityInfo& info = level.entities[ET_DOOR][i];
+
+        int x = (int)floorf(info.x / LEVEL_SCALE_FACTOR);
+        int z = (int)floorf(info.z / LEVEL_SCALE_FACTOR);
+
+        int16_t cell = GetCell(level, x, z);
+
+        if(cell == CELL_OPEN || cell == CELL_DOOR)
+            SetCell(level, x, z, CELL_DOOR);
+        else
+            fprintf(stderr, "Door %d at (%g, %g) isn't on an open cell, it won't be a portal\n", i, info.x, info.z);
+    }
+
+    // Flood fill the rooms between the doors
+    int cellCount = level.gridWidth * level.gridHeight;
+    int* stack = (int*)malloc(sizeof(int) * cellCount);
+
+    int roomCount = 0;
+
+    for(int start = 0; start < cellCount; ++start)
+    {
+        if(level.cellAreas[start] != CELL_OPEN)
+            continue;
+
+        if(roomCount >= INT16_MAX)
+            CRASH("Level has too many areas\n");
+
+        int16_t room = (int16_t)roomCount++;
+
+        int top = 0;
+
+        stack[top++] = start;
+        level.cellAreas[start] = room;
+
+        while(top > 0)
+        {
+            int cell = stack[--top];
+
+            int x = level.gridX + cell % level.gridWidth;
+            int z = level.gridZ + cell / level.gridWidth;
+
+            const int offsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+
+            for(int i = 0; i < 4; ++i)
+            {
+                int nx = x + offsets[i][0];
+                int nz = z + offsets[i][1];
+
+                if(GetCell(level, nx, nz) != CELL_OPEN)
+                    continue;
+
+                SetCell(level, nx, nz, room);
+                stack[top++] = (nz - level.gridZ) * level.gridWidth + (nx - level.gridX);
+            }
+        }
+    }
+
+    free(stack);
+
+    level.areaCount = roomCount;
+
+    if(roomCount + doorCount > INT16_MAX)
+        CRASH("Level has too many areas\n");
+
+    // Every door cell is an area, linked to the rooms around it
+    for(int i = 0; i < doorCount; ++i)
+    {
+        const EntityInfo& info = level.entities[ET_DOOR][i];
+
+        int x = (int)floorf(info.x / LEVEL_SCALE_FACTOR);
+        int z = (int)floorf(info.z / LEVEL_SCALE_FACTOR);
+
+        int16_t cell = GetCell(level, x, z);
+
+        if(cell == CELL_SOLID)
+            continue;
+
+        // Doors sharing a cell share its area
+        if(cell == CELL_DOOR)
+        {
+            cell = (int16_t)level.areaCount++;
+            SetCell(level, x, z, cell);
+        }
+
+        LevelPortal& portal = level.portals[level.portalCount++];
+
+        portal.door = i;
+        portal.area = cell;
+        portal.areas[0] = portal.areas[1] = -1;
+
+        const int offsets[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+
+        int sides = 0;
+
+        for(int j = 0; j < 4 && sides < 2; ++j)
+        {
+            int16_t side = GetCell(level, x + offsets[j][0], z + offsets[j][1]);
+
+            if(side < 0 || side >= roomCount || (sides == 1 && portal.areas[0] == side))
+                continue;
+
+            portal.areas[sides++] = side;
+        }
+    }
+
+    int rowSize = LEVEL_PVS_ROW_SIZE(level.areaCount);
+
+    level.pvs = (uint8_t*)calloc(level.areaCount, rowSize);
+
+    PortalFlow flow;
+
+    flow.onPath = (bool*)calloc(level.areaCount, sizeof(bool));
+    flow.portalVisible = (int8_t*)malloc(level.portalCount * level.portalCount + 1);
+
+    memset(flow.portalVisible, -1, level.portalCount * level.portalCount + 1);
+
+    for(int room = 0; room < roomCount; ++room)
+    {
+        flow.source = room;
+
+        SetVisible(level, room, room);
+
+        for(int i = 0; i < level.portalCount; ++i)
+        {
+            const LevelPortal& portal = level.portals[i];
+
+            if(!IsAdjacent(portal, room))
+                continue;
+
+            SetVisible(level, room, portal.area);
+
+            int next = GetOtherSide(portal, room);
+
+            if(next >= 0)
+            {
+                flow.chain[0] = i;
+                Flow(level, flow, 1, next);
+            }
+        }
+    }
+
+    free(flow.onPath);
+    free(flow.portalVisible);
+
+    // A door cell sees whatever the rooms on either side see
+    for(int i = 0; i < level.portalCount; ++i)
+    {
+        const LevelPortal& portal = level.portals[i];
+
+        uint8_t* row = &level.pvs[portal.area * rowSize];
+
+        SetVisible(level, portal.area, portal.area);
+
+        for(int j = 0; j < 2; ++j)
+        {
+            if(portal.areas[j] < 0)
+                continue;
+
+            const uint8_t* side = &level.pvs[portal.areas[j] * rowSize];
+
+            for(int k = 0; k < rowSize; ++k)
+                row[k] |= side[k];
+        }
+    }
+
+    // Seeing is mutual
+    for(int a = 0; a < level.areaCount; ++a)
+    {
+        for(int b = 0; b < level.areaCount; ++b)
+        {
+            if(IsAreaPotentiallyVisible(level, a, b))
+                SetVisible(level, b, a);
+        }
+    }
+}
+
+// Flips the plane's facing without moving it. The texture mapping gets
+// mirrored too, so it reads the right way round from the new front.
+static Level::Plane FlipPlane(const Level::Plane& plane)
+{
+    Level::Plane flipped = plane;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        flipped.o[i] = plane.o[i] + plane.b[i];
+        flipped.b[i] = -plane.b[i];
+    }
+
+    return flipped;
+}
+
+// Orders planes by the rectangle they cover and the way they face
+struct PlaneKey
+{
+    int min[3], max[3];
+    int normal[3];
+
+    int index;
+};
+
+static PlaneKey GetPlaneKey(const Level::Plane& plane, int index)
+{
+    PlaneKey key;
+
+    for(int i = 0; i < 3; ++i)
+    {
+        int x1 = plane.o[i];
+        int x2 = plane.o[i] + plane.a[i] + plane.b[i];
+
+        key.min[i] = std::min(x1, x2);
+        key.max[i] = std::max(x1, x2);
+    }
+
+    key.normal[0] = plane.a[1] * plane.b[2] - plane.a[2] * plane.b[1];
+    key.normal[1] = plane.a[2] * plane.b[0] - plane.a[0] * plane.b[2];
+    key.normal[2] = plane.a[0] * plane.b[1] - plane.a[1] * plane.b[0];
+
+    key.index = index;
+
+    return key;
+}
+
+static int ComparePlaneKeys(const PlaneKey& x, const PlaneKey& y)
+{
+    int r = memcmp(x.min, y.min, sizeof(x.min));
+    if(r == 0) r = memcmp(x.max, y.max, sizeof(x.max));
+    if(r == 0) r = memcmp(x.normal, y.normal, sizeof(x.normal));
+
+    return r;
+}
+
+void RemoveHiddenPlanes(Level& level)
+{
+    if(level.areaCount == 0)
+        return;
+
+    // Floors are the lowest horizontal planes, anything above them is a ceiling
+    bool anyFloor = false;
+    int floorY = 0;
+
+    for(int i = 0; i < level.planeCount; ++i)
+    {
+        const Level::Plane& plane = level.planes[i];
+
+        if(plane.a[1] != 0 || plane.b[1] != 0)
+            continue;
+
+        if(!anyFloor || plane.o[1] < floorY)
+            floorY = plane.o[1];
+
+        anyFloor = true;
+    }
+
+    const int quarter = CELL_HALF_UNITS * 2;
+
+    // Worst case every plane sits between two open cells
+    Level::Plane* planes = (Level::Plane*)malloc(sizeof(Level::Plane) * level.planeCount * 2 + 1);
+    int planeCount = 0;
+
+    int hidden = 0, flipped = 0;
+
+    for(int i = 0; i < level.planeCount; ++i)
+    {
+        const Level::Plane& plane = level.planes[i];
+
+        // Center of the plane in quarter cells
+        int c[3];
+
+        for(int j = 0; j < 3; ++j)
+            c[j] = plane.o[j] * 2 + plane.a[j] + plane.b[j];
+
+        PlaneKey key = GetPlaneKey(plane, i);
+        const int* n = key.normal;
+
+        // Not axis aligned, leave it alone
+        if((n[0] != 0) + (n[1] != 0) + (n[2] != 0) != 1)
+        {
+            planes[planeCount++] = plane;
+            continue;
+        }
+
+        if(n[1] != 0)
+        {
+            if(GetCell(level, FloorDiv(c[0], quarter), FloorDiv(c[2], quarter)) < 0)
+            {
+                hidden += 1;
+                continue;
+            }
+
+            bool up = plane.o[1] <= floorY;
+
+            if((n[1] > 0) == up)
+                planes[planeCount++] = plane;
+            else
+            {
+                planes[planeCount++] = FlipPlane(plane);
+                flipped += 1;
+            }
+
+            continue;
+        }
+
+        int axis = n[0] != 0 ? 0 : 2;
+        int step = n[axis] > 0 ? 1 : -1;
+
+        int front[3] = { c[0], c[1], c[2] };
+        int back[3] = { c[0], c[1], c[2] };
+
+        front[axis] += step;
+        back[axis] -= step;
+
+        bool frontOpen = GetCell(level, FloorDiv(front[0], quarter), FloorDiv(front[2], quarter)) >= 0;
+        bool backOpen = GetCell(level, FloorDiv(back[0], quarter), FloorDiv(back[2], quarter)) >= 0;
+
+        if(!frontOpen && !backOpen)
+        {
+            hidden += 1;
+            continue;
+        }
+
+        if(frontOpen)
+            planes[planeCount++] = plane;
+
+        if(backOpen)
+        {
+            planes[planeCount++] = FlipPlane(plane);
+            flipped += 1;
+        }
+    }
+
+    // Drop planes covering the same rectangle facing the same way (the
+    // first one in the file wins)
+    PlaneKey* keys = (PlaneKey*)malloc(sizeof(PlaneKey) * planeCount + 1);
+
+    for(int i = 0; i < planeCount; ++i)
+        keys[i] = GetPlaneKey(planes[i], i);
+
+    std::sort(keys, keys + planeCount, [](const PlaneKey& x, const PlaneKey& y) {
+        int r = ComparePlaneKeys(x, y);
+        return r != 0 ? r < 0 : x.index < y.index;
+    });
+
+    bool* keep = (bool*)malloc(sizeof(bool) * planeCount + 1);
+
+    for(int i = 0; i < planeCount; ++i)
+        keep[keys[i].index] = i == 0 || ComparePlaneKeys(keys[i - 1], keys[i]) != 0;
+
+    int duplicates = 0;
+    int count = 0;
+
+    for(int i = 0; i < planeCount; ++i)
+    {
+        if(keep[i])
+            planes[count++] = planes[i];
+        else
+            duplicates += 1;
+    }
+
+    free(keys);
+    free(keep);
+
+    printf("Removed %d hidden and %d duplicate planes, flipped %d (%d -> %d planes)\n",
+           hidden, duplicates, flipped, level.planeCount, count);
+
+    free(level.planes);
+
+    level.planes = planes;
+    level.planeCount = count;
+}
+
+int GetLevelArea(const Level& level, float x, float z)
+{
+    if(level.areaCount == 0)
+        return -1;
+
+    return GetCell(level, (int)floorf(x / LEVEL_SCALE_FACTOR), (int)floorf(z / LEVEL_SCALE_FACTOR));
+}
+
+int GetPlaneArea(const Level& level, const Level::Plane& plane)
+{
+    if(level.areaCount == 0)
+        return -1;
+
+    // Center of the plane in quarter cells
+    int c[3];
+
+    for(int i = 0; i < 3; ++i)
+        c[i] = plane.o[i] * 2 + plane.a[i] + plane.b[i];
+
+    const int quarter = CELL_HALF_UNITS * 2;
+
+    int n[3] =
+    {
+        plane.a[1] * plane.b[2] - plane.a[2] * plane.b[1],
+        plane.a[2] * plane.b[0] - plane.a[0] * plane.b[2],
+        plane.a[0] * plane.b[1] - plane.a[1] * plane.b[0]
+    };
+
+    // Floors belong to the cell they cover
+    if(n[0] == 0 && n[2] == 0)
+        return GetCell(level, FloorDiv(c[0], quarter), FloorDiv(c[2], quarter));
+
+    if(n[0] != 0 && n[2] != 0)
+        return -1;
+
+    // Walls belong to the open cell they face
+    int axis = n[0] != 0 ? 0 : 2;
+    int step = n[axis] > 0 ? 1 : -1;
+
+    int front[3] = { c[0], c[1], c[2] };
+    int back[3] = { c[0], c[1], c[2] };
+
+    front[axis] += step;
+    back[axis] -= step;
+
+    int frontArea = GetCell(level, FloorDiv(front[0], quarter), FloorDiv(front[2], quarter));
+    int backArea = GetCell(level, FloorDiv(back[0], quarter), FloorDiv(back[2], quarter));
+
+    if(frontArea < 0)
+        return backArea;
+
+    if(backArea < 0 || backArea == frontArea)
+        return frontArea;
+
+    return -1;
+}
+
+bool IsAreaPotentiallyVisible(const Level& level, int from, int to)
+{
+    // Anything we don't know about might be visible
+    if(from < 0 || to < 0 || from >= level.areaCount || to >= level.areaCount)
+        return true;
+
+    return (level.pvs[from * LEVEL_PVS_ROW_SIZE(level.areaCount) + to / 8] >> (to % 8)) & 1;
+}
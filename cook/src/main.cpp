@@ -0,0 +1,130 @@
+#include <SDL.h>
+#include <string.h>
+
+#include "resources.hpp"
+#include "utils.hpp"
+#include "visibility.hpp"
+
+// Offline asset conversion
+//
+// Usage:
+//  cook level path/to/level.map path/to/level.lvl
+//  cook mesh path/to/mesh.obj path/to/mesh.msh
+//  cook pack [--store] path/to/assets.pak name=path/to/file ...
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage:\n");
+    fprintf(stderr, "  cook level <input.map> <output.lvl>\n");
+    fprintf(stderr, "  cook mesh <input.obj> <output.msh>\n");
+    fprintf(stderr, "  cook pack [--store] <output.pak> <name>=<path> ...\n");
+}
+
+static int CookLevel(const char* input, const char* output)
+{
+    Level level = LoadLevel(input);
+
+    BakeLevelVisibility(level);
+    RemoveHiddenPlanes(level);
+
+    SaveLevel(level, output);
+
+    printf("Cooked level '%s' -> '%s' (%d planes, %d areas, %d portals)\n", input, output,
+           level.planeCount, level.areaCount, level.portalCount);
+
+    DestroyLevel(level);
+
+    return 0;
+}
+
+static int CookMesh(const char* input, const char* output)
+{
+    MeshData data = LoadMeshData(input);
+
+    SaveMeshData(data, output);
+
+    printf("Cooked mesh '%s' -> '%s' (%d vertices, %d indices)\n", input, output, data.vertexCount, data.indexCount);
+
+    DestroyMeshData(data);
+
+    return 0;
+}
+
+// Each entry is given as name=path, where name is what the game loads
+// it as (e.g. textures/wolf.png)
+static int CookPack(int argc, char** argv)
+{
+    bool compress = true;
+
+    if(argc > 0 && strcmp(argv[0], "--store") == 0)
+    {
+        compress = false;
+
+        argc -= 1;
+        argv += 1;
+    }
+
+    if(argc < 1)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    const char* output = argv[0];
+
+    int count = argc - 1;
+
+    const char** names = (const char**)malloc(sizeof(const char*) * count);
+    const char** paths = (const char**)malloc(sizeof(const char*) * count);
+
+    for(int i = 0; i < count; ++i)
+    {
+        char* entry = argv[i + 1];
+        char* sep = strchr(entry, '=');
+
+        if(!sep)
+        {
+            fprintf(stderr, "Pack entry '%s' should be name=path\n", entry);
+            return 1;
+        }
+
+        *sep = '\0';
+
+        names[i] = entry;
+        paths[i] = sep + 1;
+    }
+
+    if(!WritePack(output, count, names, paths, compress))
+    {
+        fprintf(stderr, "Failed to write asset pack '%s'\n", output);
+        return 1;
+    }
+
+    printf("Cooked pack '%s' (%d entries)\n", output, count);
+
+    free(names);
+    free(paths);
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if(strcmp(argv[1], "level") == 0 && argc == 4)
+        return CookLevel(argv[2], argv[3]);
+
+    if(strcmp(argv[1], "mesh") == 0 && argc == 4)
+        return CookMesh(argv[2], argv[3]);
+
+    if(strcmp(argv[1], "pack") == 0)
+        return CookPack(argc - 2, argv + 2);
+
+    PrintUsage();
+    return 1;
+}
@@ -3,9 +3,11 @@
 #include <glm/gtx/transform.hpp>
 
 #include "context.hpp"
+#include "pack.hpp"
 
 #include "editor.hpp"
 #include "draw.hpp"
+#include "stream.hpp"
 
 #undef main
 
@@ -15,6 +17,9 @@ static const int WINDOW_HEIGHT = 480;
 int main(int argc, char** argv)
 {
     Context context = CreateContext("Wolf3D Level Editor", WINDOW_WIDTH, WINDOW_HEIGHT, CONTEXT_SCALE_GROW);
+
+    // Loose files are used if there's no pack
+    OpenPack("assets.pak");
     
     InitDraw(WINDOW_WIDTH, WINDOW_HEIGHT);
 
@@ -51,11 +56,16 @@ int main(int argc, char** argv)
 
         SetViewSize(context.viewWidth, context.viewHeight);
         Draw(editor);
+        FlushDraw();
+
+        EndStreamFrame();
    
         SDL_GL_SwapWindow(context.window);
     }
 
     DestroyDraw();
+    ClosePack();
+
 	DestroyContext(context);
 
     return 0;
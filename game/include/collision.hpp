@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "game.hpp"
+
+// Entity vs entity and ray vs entity tests used by the simulation.
+// typeMask arguments are bitmasks of entity types, built with ET_MASK
+// (e.g. ET_MASK(ET_DOOR) | ET_MASK(ET_ENEMY)).
+
+// Most entities GetHitEntity considers per ray
+static const int GAME_MAX_HIT_CHECK_ENTS = 20;
+// How far in front of the hit surface GetHitEntity puts hitPos
+static const float IMPACT_HOVER_EPSILON = 0.1f;
+
+inline glm::vec3 Pos(const Entity& e)
+{
+    return glm::vec3(e.x, e.y, e.z);
+}
+
+// Projects x, z onto each of the 8 directions (45 degrees apart) and
+// picks the one with the largest projection. If major is true only the
+// 4 major directions are considered.
+int VecToDir(float x, float z, bool major = false);
+
+bool PointInBox(const glm::vec3& p, const glm::vec3& pos, const glm::vec3& min, const glm::vec3& max);
+
+// Assumes dir is normalized. t is where the ray enters the box.
+bool RayBox(const glm::vec3& start, const glm::vec3& dir, const glm::vec3& pos, const glm::vec3& min, const glm::vec3& max, float* t = nullptr);
+
+// Closest entity hit by a horizontal ray from x, y, z along angle
+Entity* GetHitEntity(float x, float y, float z, float angle, Game& game, int typeMask, EntityType& type, glm::vec3& hitPos);
+
+// Would a at x, y, z overlap b
+bool Collide(const Entity& a, float x, float y, float z, const Entity& b);
+bool CollideSolids(const Entity& e, float x, float y, float z, int typeMask, const Game& game);
+
+// Moves one axis at a time, dropping the axes which would collide
+void MoveBy(Entity& e, float x, float y, float z, int typeMask, const Game& game);
@@ -4,10 +4,20 @@
 
 #include "resources.hpp"
 #include "graphics.hpp"
+#include "renderqueue.hpp"
 
 static const int GAME_MAX_BULLET_IMPACTS = 64;
 static const int GAME_MAX_TRACERS = 32;
 
+static const char* const GAME_DEFAULT_LEVEL = "levels/test.lvl";
+
+// Update always steps by 1 / tick rate (see main.cpp)
+static const int GAME_DEFAULT_TICK_RATE = 60;
+// Ticks run in one frame before the rest of a hitch is dropped
+static const int GAME_MAX_TICKS_PER_FRAME = 5;
+
+struct RenderState;
+
 struct Entity
 {
     bool hasbb = false;
@@ -103,10 +113,33 @@ struct Game
     
     Level level;
 
+    // Areas which could be seen this frame, one per level area (null if
+    // the level has no baked visibility)
+    mutable bool* visibleAreas = nullptr;
+
     bool debugDraw = false;
 
-    mutable Mesh enemyMesh;
-    mutable Mesh levelMesh;
+    // Every random choice the simulation makes comes from here (see
+    // SeedRandom)
+    uint32_t rngState = 1;
+
+    // All enemies are drawn in one instanced call
+    mutable BillboardBatch enemyBatch;
+    mutable BillboardInstance* enemyInstances = nullptr;
+
+    // Same for doors and paintings (one call per prop type)
+    mutable PropBatch doorBatch;
+    mutable PropBatch paintingBatch;
+    mutable PropInstance* doorInstances = nullptr;
+    mutable PropInstance* paintingInstances = nullptr;
+
+    // Everything is drawn through this, in the order it sorts to
+    mutable RenderQueue renderQueue;
+
+    // Snapshot being drawn, for the render queue callbacks
+    mutable const RenderState* drawState = nullptr;
+
+    mutable LevelMesh levelMesh;
     mutable Mesh gunMesh;
     mutable Mesh doorMesh;
     mutable Mesh paintingMesh;
@@ -126,10 +159,58 @@ struct Game
     Texture tracerTexture;
 
     Shader basicShader;
+    Shader levelShader;
+    Shader billboardShader;
+    Shader propShader;
     Shader spriteShader;
 };
 
+// Everything Draw reads from the simulation, copied out after each update.
+// The render thread draws one of these while the next update runs, so
+// Draw only reads the game for resources (meshes, textures, the level).
+struct RenderState
+{
+    Player player;
+
+    bool debugDraw = false;
+
+    int doorCount = 0;
+    Door* doors = nullptr;
+
+    int enemyCount = 0;
+    Enemy* enemies = nullptr;
+
+    int paintingCount = 0;
+    Painting* paintings = nullptr;
+
+    Impact impacts[GAME_MAX_BULLET_IMPACTS];
+    Tracer tracers[GAME_MAX_TRACERS];
+};
+
+// Loads the level and sets up the entities. Needs no window or GL, so
+// it's all Update needs (see headless.cpp).
+void InitState(Game& game, const char* levelFilename = GAME_DEFAULT_LEVEL);
+// Same for a level which is already loaded. The game takes it over.
+void InitState(Game& game, const Level& level);
+// Shaders, textures, meshes and batches. Needs the GL context and
+// InitState to have run.
+void InitRender(Game& game);
+// Both of the above
 void Init(Game& game);
+
+void SeedRandom(Game& game, uint32_t seed);
 void Update(Game& game, float dt);
-void Draw(const Game& game, const glm::mat4& proj);
+void Draw(const Game& game, const RenderState& state, const glm::mat4& proj);
+
+void DestroyRender(Game& game);
+void DestroyState(Game& game);
 void Destroy(Game& game);
+
+// Sized for the game's entities, so call it after Init
+void CreateRenderState(const Game& game, RenderState& state);
+void Snapshot(const Game& game, RenderState& state);
+// Blends the state (a snapshot of the latest tick) back towards the one
+// before it. Alpha is how far into the next tick the frame is, 0 gives
+// prev and 1 gives the state unchanged.
+void Interpolate(const RenderState& prev, float alpha, RenderState& state);
+void DestroyRenderState(RenderState& state);
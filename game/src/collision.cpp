@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <math.h>
+
+#include "collision.hpp"
+#include "utils.hpp"
+
+int VecToDir(float x, float z, bool major)
+{
+    const float dirs[8][2] =
+    {
+        // x, z
+        { sinf(0.0f), cosf(0.0f) }, 
+        { sinf((float)M_PI / 4), cosf((float)M_PI / 4) }, 
+        { sinf((float)M_PI / 2), cosf((float)M_PI / 2) }, 
+        { sinf((float)M_PI / 2 + (float)M_PI / 4), cosf((float)M_PI / 2 + (float)M_PI / 4) }, 
+        { sinf((float)M_PI), cosf((float)M_PI) }, 
+        { sinf((float)M_PI + (float)M_PI / 4), cosf((float)M_PI + (float)M_PI / 4) }, 
+        { sinf((float)M_PI + (float)M_PI / 2), cosf((float)M_PI + (float)M_PI / 2) },
+        { sinf((float)M_PI + (float)M_PI / 2 + (float)M_PI / 4), cosf((float)M_PI + (float)M_PI / 2 + (float)M_PI / 4) }
+    };
+
+    int maxDir = 0;
+    float maxDot = 0;
+
+    for(int i = 0; i < 8; ++i) 
+    {
+        if(major && i % 2 != 0) continue;
+
+        float dot = dirs[i][0] * x + dirs[i][1] * z;
+        
+        if(dot > maxDot)
+        {
+            maxDir = i;
+            maxDot = dot;
+        }
+    }
+    
+    return maxDir;
+}
+
+bool PointInBox(const glm::vec3& p, const glm::vec3& pos, const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec3 pmin = pos + min;
+    glm::vec3 pmax = pos + max;
+
+    return p.x > pmin.x && p.x < pmax.x &&
+           p.y > pmin.y && p.y < pmax.y &&
+           p.z > pmin.z && p.z < pmax.z;
+}
+
+bool RayBox(const glm::vec3& start, const glm::vec3& dir, const glm::vec3& pos, const glm::vec3& min, const glm::vec3& max, float* t)
+{
+#if 1
+	float tmin = -INFINITY;
+	float tmax = INFINITY;
+
+    for(int i = 0; i < 3; ++i)
+    {
+		if (dir[i] == 0.0f) continue;
+
+        float tx1 = ((min[i] + pos[i]) - start[i])/dir[i];
+        float tx2 = ((max[i] + pos[i]) - start[i])/dir[i];
+
+        tmin = std::max(tmin, std::min(tx1, tx2));
+        tmax = std::min(tmax, std::max(tx1, tx2));
+    }
+
+    if(t)
+        *t = tmin;
+
+    return tmax >= 0 && tmax >= tmin;
+#else 
+    glm::vec3 c = (min + max) / 2.0f + pos;
+
+    glm::vec3 diff = c - start;
+    float dot = glm::dot(diff, dir);
+    
+    if(dot < 0) return false;
+
+    glm::vec3 p = start + dir * dot;
+
+    glm::vec3 pdiff = c - p;
+
+    glm::vec3 clampedDiff = glm::clamp(pdiff, min, max);
+
+    if(glm::length2(clampedDiff) >= glm::length2(pdiff))
+    {
+        if(hit)
+        {
+            // TODO: Implement properly
+
+            // step from the the start and the perpendicular length point p
+            // until you hit the wall, move back and call that the hit location
+            const float tmove = dot / RAY_BOX_HIT_SAMPLE_COUNT;
+            float t = 0;
+
+            glm::vec3 pt;
+            for(int i = 0; i < RAY_BOX_HIT_SAMPLE_COUNT; ++i)
+			{
+				pt = start + dir * t;
+                t += tmove;
+
+				if (PointInBox(pt, pos, min, max))
+                {
+                    pt -= dir;
+					break;
+                }
+            };
+
+            *hit = pt;
+        }
+
+        return true;
+    }
+
+    return false;
+#endif
+}
+
+// TODO: Refactor this so it returns a bool and takes a Hit& or something
+Entity* GetHitEntity(float x, float y, float z, float angle, Game& game, int typeMask, EntityType& type, glm::vec3& hitPos)
+{
+	struct Hit
+	{
+		EntityType etype;
+		Entity* e;
+        float t;
+	};
+
+    int entityCount = 0;
+
+    static EntityType types[GAME_MAX_HIT_CHECK_ENTS];
+    static Entity* entities[GAME_MAX_HIT_CHECK_ENTS];
+
+    int hitCount = 0;
+	static Hit hits[GAME_MAX_HIT_CHECK_ENTS];
+    
+    // TODO: Prune more entities which shouldn't be checked
+
+    glm::vec3 start{x, y, z};
+    glm::vec3 dir{sinf(angle), 0, cosf(angle)}; 
+
+    if(typeMask & ET_MASK(ET_DOOR))
+    {
+        for(int i = 0; i < game.doorCount; ++i)
+        {
+            if(entityCount >= COUNT_OF(entities)) break;
+            types[entityCount] = ET_DOOR;
+            entities[entityCount++] = &game.doors[i];
+        }
+    }
+
+    if(typeMask & ET_MASK(ET_ENEMY))
+    {
+        for(int i = 0; i < game.enemyCount; ++i)
+        {
+            if(entityCount >= COUNT_OF(entities)) break;
+            if(game.enemies[i].health <= 0) continue;
+            types[entityCount] = ET_ENEMY;
+            entities[entityCount++] = &game.enemies[i];
+        }
+    }
+
+    if(typeMask & ET_MASK(ET_PAINTING))
+    {
+        for(int i = 0; i < game.paintingCount; ++i)
+        {
+            if(entityCount >= COUNT_OF(entities)) break;
+            types[entityCount] = ET_PAINTING;
+            entities[entityCount++] = &game.paintings[i];
+        }
+    }
+
+    if(typeMask & ET_MASK(ET_BOXCOLLIDER))
+    {
+        for(int i = 0; i < game.boxColliderCount; ++i)
+        {
+            if(entityCount >= COUNT_OF(entities)) break;
+
+            types[entityCount] = ET_BOXCOLLIDER;
+            entities[entityCount++] = &game.boxColliders[i];
+        }
+    }
+
+    for(int i = 0; i < entityCount; ++i)
+    {
+        Entity& ent = *entities[i];
+		float t;
+        if(RayBox(start, dir, glm::vec3(ent.x, ent.y, ent.z), ent.min, ent.max, &t))
+        {
+            if(hitCount >= GAME_MAX_HIT_CHECK_ENTS) break;
+
+            hits[hitCount++] = { types[i], &ent, t };
+        }
+    }
+
+    // TODO: Better priority system; perhaps sort by type on top of distance?
+    std::sort(hits, hits + hitCount, [](const Hit& a, const Hit& b) {
+        return a.t < b.t;
+    });
+
+    if(hitCount > 0)
+    {
+		type = hits[0].etype;
+        hitPos = start + dir * (hits[0].t - IMPACT_HOVER_EPSILON);
+		return hits[0].e;
+    }
+
+    return nullptr;
+}
+
+bool Collide(const Entity& a, float x, float y, float z, const Entity& b)
+{
+    if(!a.hasbb || !b.hasbb) return false;
+
+    glm::vec3 amin = glm::vec3(x, y, z) + a.min;
+    glm::vec3 amax = glm::vec3(x, y, z) + a.max;
+
+    glm::vec3 bmin = glm::vec3(b.x, b.y, b.z) + b.min;
+    glm::vec3 bmax = glm::vec3(b.x, b.y, b.z) + b.max;
+
+	if (amax.x < bmin.x || bmax.x < amin.x) return false;
+	if (amax.y < bmin.y || bmax.y < amin.y) return false;
+	if (amax.z < bmin.z || bmax.z < amin.z) return false;
+
+    return true;
+}
+
+bool CollideSolids(const Entity& e, float x, float y, float z, int typeMask, const Game& game)
+{
+    // TODO: Skip all entities that match e of every time
+
+    if(typeMask & ET_MASK(ET_ENEMY))
+    {
+        for(int i = 0; i < game.enemyCount; ++i)
+        {
+            if(&e == &game.enemies[i]) continue;
+            if(Collide(e, x, y, z, game.enemies[i]))
+                return true;
+        }
+    }
+
+    if(typeMask & ET_MASK(ET_BOXCOLLIDER))
+    {
+        for(int i = 0; i < game.boxColliderCount; ++i)
+        {
+            if(Collide(e, x, y, z, game.boxColliders[i]))
+                return true;
+        }
+    }
+    
+    if(typeMask & ET_MASK(ET_DOOR))
+    {
+        for(int i = 0; i < game.doorCount; ++i)
+        {
+            if(Collide(e, x, y, z, game.doors[i]))
+                return true;
+        }
+    }
+
+    if(typeMask & ET_MASK(ET_PAINTING))
+    {
+        for(int i = 0; i < game.paintingCount; ++i)
+        {
+            if(Collide(e, x, y, z, game.paintings[i]))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+void MoveBy(Entity& e, float x, float y, float z, int typeMask, const Game& game)
+{
+    // TODO: Clean this up so it's not doing float cmp
+    if(x != 0)
+    {
+        if(CollideSolids(e, e.x + x, e.y, e.z, typeMask, game)) x = 0;
+        e.x += x;
+    }
+
+    if(y != 0)
+    {
+        if(CollideSolids(e, e.x, e.y + y, e.z, typeMask, game)) y = 0;
+        e.y += y;
+    }
+    
+    if(z != 0)
+    {
+        if(CollideSolids(e, e.x, e.y, e.z + z, typeMask, game)) z = 0;
+        e.z += z;
+    }
+}
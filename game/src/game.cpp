@@ -6,13 +6,17 @@
 #include <stdio.h>
 
 #include "game.hpp"
+#include "collision.hpp"
+#include "glstate.hpp"
 #include "input.hpp"
+#include "loader.hpp"
+#include "profile.hpp"
 #include "utils.hpp"
+#include "visibility.hpp"
 
 static const int VIEW_WIDTH = 640;
 static const int VIEW_HEIGHT = 480;
 
-static const int GAME_MAX_HIT_CHECK_ENTS = 20;
 static const int MAX_SHOT_LEVEL_INTERSECTIONS = 20;
 static const float PLAYER_DOOR_OPEN_DIST = 2.5f;
 static const float PLAYER_LOOK_SPEED = 0.3f;
@@ -28,15 +32,24 @@ static const float ENEMY_SIGHT_DIST = 7.0f;
 static const float ENEMY_SAW_PLAYER_TIME = 0.25f;
 static const float ENEMY_START_CHASE_TIME = 0.25f;
 static const float IMPACT_LIFE = 10.0f;
-static const float IMPACT_HOVER_EPSILON = 0.1f;
 static const float TRACER_MOVE_SPEED = 1.0f;
 static const float TRACER_Y_OFF = -0.2f;
 static const float TRACER_LIFE = 10.0f;
 static const float DIR_DEGREES = 45.0f;
 
-inline static glm::vec3 Pos(const Entity& e)
+// Xorshift, so a replay with the same seed makes the same choices
+static float Random(Game& game)
 {
-    return glm::vec3(e.x, e.y, e.z);
+    uint32_t x = game.rngState;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    game.rngState = x;
+
+    // Top 24 bits, exactly representable as a float in [0, 1)
+    return (x >> 8) / 16777216.0f;
 }
 
 static bool LinePlane(const glm::vec3& lineStart, const glm::vec3& lineEnd, const glm::vec3& planeOrigin, const glm::vec3& planeNormal, glm::vec3* hit = nullptr)
@@ -79,44 +92,6 @@ static void Forward(float lookAngle, float& x, float& z, float scale = 1)
     z = cosf(lookAngle) * scale;
 }
 
-// Projects the x, y coords onto each direction's vector,
-// picking the one with the largest projection
-// If major is true, then only the major directions are
-// returned
-static int VecToDir(float x, float z, bool major = false)
-{
-    const float dirs[8][2] =
-    {
-        // x, z
-        { sinf(0.0f), cosf(0.0f) }, 
-        { sinf((float)M_PI / 4), cosf((float)M_PI / 4) }, 
-        { sinf((float)M_PI / 2), cosf((float)M_PI / 2) }, 
-        { sinf((float)M_PI / 2 + (float)M_PI / 4), cosf((float)M_PI / 2 + (float)M_PI / 4) }, 
-        { sinf((float)M_PI), cosf((float)M_PI) }, 
-        { sinf((float)M_PI + (float)M_PI / 4), cosf((float)M_PI + (float)M_PI / 4) }, 
-        { sinf((float)M_PI + (float)M_PI / 2), cosf((float)M_PI + (float)M_PI / 2) },
-        { sinf((float)M_PI + (float)M_PI / 2 + (float)M_PI / 4), cosf((float)M_PI + (float)M_PI / 2 + (float)M_PI / 4) }
-    };
-
-    int maxDir = 0;
-    float maxDot = 0;
-
-    for(int i = 0; i < 8; ++i) 
-    {
-        if(major && i % 2 != 0) continue;
-
-        float dot = dirs[i][0] * x + dirs[i][1] * z;
-        
-        if(dot > maxDot)
-        {
-            maxDir = i;
-            maxDot = dot;
-        }
-    }
-    
-    return maxDir;
-}
-
 static void CreateImpact(Game& game, float x, float y, float z, int dir)
 {
     for(int i = 0; i < GAME_MAX_BULLET_IMPACTS; ++i)
@@ -150,178 +125,6 @@ static void CreateTracer(Game& game, float x, float y, float z, float angle)
     }
 }
 
-static bool PointInBox(const glm::vec3& p, const glm::vec3& pos, const glm::vec3& min, const glm::vec3& max)
-{
-    glm::vec3 pmin = pos + min;
-    glm::vec3 pmax = pos + max;
-
-    return p.x > pmin.x && p.x < pmax.x &&
-           p.y > pmin.y && p.y < pmax.y &&
-           p.z > pmin.z && p.z < pmax.z;
-}
-
-// Assumes direction is normalized
-static bool RayBox(const glm::vec3& start, const glm::vec3& dir, const glm::vec3& pos, const glm::vec3& min, const glm::vec3& max, float* t = nullptr)
-{
-#if 1
-	float tmin = -INFINITY;
-	float tmax = INFINITY;
-
-    for(int i = 0; i < 3; ++i)
-    {
-		if (dir[i] == 0.0f) continue;
-
-        float tx1 = ((min[i] + pos[i]) - start[i])/dir[i];
-        float tx2 = ((max[i] + pos[i]) - start[i])/dir[i];
-
-        tmin = max(tmin, min(tx1, tx2));
-        tmax = min(tmax, max(tx1, tx2));
-    }
-
-    *t = tmin;
-
-    return tmax >= 0 && tmax >= tmin;
-#else 
-    glm::vec3 c = (min + max) / 2.0f + pos;
-
-    glm::vec3 diff = c - start;
-    float dot = glm::dot(diff, dir);
-    
-    if(dot < 0) return false;
-
-    glm::vec3 p = start + dir * dot;
-
-    glm::vec3 pdiff = c - p;
-
-    glm::vec3 clampedDiff = glm::clamp(pdiff, min, max);
-
-    if(glm::length2(clampedDiff) >= glm::length2(pdiff))
-    {
-        if(hit)
-        {
-            // TODO: Implement properly
-
-            // step from the the start and the perpendicular length point p
-            // until you hit the wall, move back and call that the hit location
-            const float tmove = dot / RAY_BOX_HIT_SAMPLE_COUNT;
-            float t = 0;
-
-            glm::vec3 pt;
-            for(int i = 0; i < RAY_BOX_HIT_SAMPLE_COUNT; ++i)
-			{
-				pt = start + dir * t;
-                t += tmove;
-
-				if (PointInBox(pt, pos, min, max))
-                {
-                    pt -= dir;
-					break;
-                }
-            };
-
-            *hit = pt;
-        }
-
-        return true;
-    }
-
-    return false;
-#endif
-}
-
-// TODO: Refactor this so it returns a bool and takes a Hit& or something
-// typeMask is a bitmask of entity types (created using ET_MASK(ET_PLAYER) | ET_MASK(ET_PAINTING)
-static Entity* GetHitEntity(float x, float y, float z, float angle, Game& game, int typeMask, EntityType& type, glm::vec3& hitPos)
-{
-	struct Hit
-	{
-		EntityType etype;
-		Entity* e;
-        float t;
-	};
-
-    int entityCount = 0;
-
-    static EntityType types[GAME_MAX_HIT_CHECK_ENTS];
-    static Entity* entities[GAME_MAX_HIT_CHECK_ENTS];
-
-    int hitCount = 0;
-	static Hit hits[GAME_MAX_HIT_CHECK_ENTS];
-    
-    // TODO: Prune more entities which shouldn't be checked
-
-    glm::vec3 start{x, y, z};
-    glm::vec3 dir{sinf(angle), 0, cosf(angle)}; 
-
-    if(typeMask & ET_MASK(ET_DOOR))
-    {
-        for(int i = 0; i < game.doorCount; ++i)
-        {
-            if(entityCount >= COUNT_OF(entities)) break;
-            types[entityCount] = ET_DOOR;
-            entities[entityCount++] = &game.doors[i];
-        }
-    }
-
-    if(typeMask & ET_MASK(ET_ENEMY))
-    {
-        for(int i = 0; i < game.enemyCount; ++i)
-        {
-            if(entityCount >= COUNT_OF(entities)) break;
-            if(game.enemies[i].health <= 0) continue;
-            types[entityCount] = ET_ENEMY;
-            entities[entityCount++] = &game.enemies[i];
-        }
-    }
-
-    if(typeMask & ET_MASK(ET_PAINTING))
-    {
-        for(int i = 0; i < game.paintingCount; ++i)
-        {
-            if(entityCount >= COUNT_OF(entities)) break;
-            types[entityCount] = ET_PAINTING;
-            entities[entityCount++] = &game.paintings[i];
-        }
-    }
-
-    if(typeMask & ET_MASK(ET_BOXCOLLIDER))
-    {
-        for(int i = 0; i < game.boxColliderCount; ++i)
-        {
-            if(entityCount >= COUNT_OF(entities)) break;
-
-            types[entityCount] = ET_BOXCOLLIDER;
-            entities[entityCount++] = &game.boxColliders[i];
-        }
-    }
-
-    for(int i = 0; i < entityCount; ++i)
-    {
-        Entity& ent = *entities[i];
-		float t;
-        if(RayBox(start, dir, glm::vec3(ent.x, ent.y, ent.z), ent.min, ent.max, &t))
-        {
-            if(hitCount >= GAME_MAX_HIT_CHECK_ENTS) break;
-
-            hits[hitCount++] = { types[i], &ent, t };
-        }
-    }
-
-    // TODO: Better priority system; perhaps sort by type on top of distance?
-    std::sort(hits, hits + hitCount, [](const Hit& a, const Hit& b) {
-        return a.t < b.t;
-    });
-
-    if(hitCount > 0)
-    {
-		type = hits[0].etype;
-        hitPos = start + dir * (hits[0].t - IMPACT_HOVER_EPSILON);
-		return hits[0].e;
-    }
-
-    return nullptr;
-}
-
 static void Shoot(float x, float y, float z, float angle, Game& game)
 {
     //CreateTracer(game, x, y + TRACER_Y_OFF, z, angle);
@@ -351,7 +154,7 @@ static void Shoot(float x, float y, float z, float angle, Game& game)
             Painting& painting = *(Painting*)ent;
 
             painting.hit = true;
-            painting.angularVel += ((float)rand() / RAND_MAX) - 0.5f;
+            painting.angularVel += Random(game) - 0.5f;
         }
         else if(etype == ET_BOXCOLLIDER)
         {
@@ -369,89 +172,6 @@ static void Shoot(float x, float y, float z, float angle, Game& game)
     }
 }
 
-static bool Collide(const Entity& a, float x, float y, float z, const Entity& b)
-{
-    if(!a.hasbb || !b.hasbb) return false;
-
-    glm::vec3 amin = glm::vec3(x, y, z) + a.min;
-    glm::vec3 amax = glm::vec3(x, y, z) + a.max;
-
-    glm::vec3 bmin = glm::vec3(b.x, b.y, b.z) + b.min;
-    glm::vec3 bmax = glm::vec3(b.x, b.y, b.z) + b.max;
-
-	if (amax.x < bmin.x || bmax.x < amin.x) return false;
-	if (amax.y < bmin.y || bmax.y < amin.y) return false;
-	if (amax.z < bmin.z || bmax.z < amin.z) return false;
-
-    return true;
-}
-
-static bool CollideSolids(const Entity& e, float x, float y, float z, int typeMask, const Game& game)
-{
-    // TODO: Skip all entities that match e of every time
-
-    if(typeMask & ET_MASK(ET_ENEMY))
-    {
-        for(int i = 0; i < game.enemyCount; ++i)
-        {
-            if(&e == &game.enemies[i]) continue;
-            if(Collide(e, x, y, z, game.enemies[i]))
-                return true;
-        }
-    }
-
-    if(typeMask & ET_MASK(ET_BOXCOLLIDER))
-    {
-        for(int i = 0; i < game.boxColliderCount; ++i)
-        {
-            if(Collide(e, x, y, z, game.boxColliders[i]))
-                return true;
-        }
-    }
-    
-    if(typeMask & ET_MASK(ET_DOOR))
-    {
-        for(int i = 0; i < game.doorCount; ++i)
-        {
-            if(Collide(e, x, y, z, game.doors[i]))
-                return true;
-        }
-    }
-
-    if(typeMask & ET_MASK(ET_PAINTING))
-    {
-        for(int i = 0; i < game.paintingCount; ++i)
-        {
-            if(Collide(e, x, y, z, game.paintings[i]))
-                return true;
-        }
-    }
-
-    return false;
-}
-
-static void MoveBy(Entity& e, float x, float y, float z, int typeMask, const Game& game)
-{
-    // TODO: Clean this up so it's not doing float cmp
-    if(x != 0)
-    {
-        if(CollideSolids(e, e.x + x, e.y, e.z, typeMask, game)) x = 0;
-        e.x += x;
-    }
-
-    if(y != 0)
-    {
-        if(CollideSolids(e, e.x, e.y + y, e.z, typeMask, game)) y = 0;
-        e.y += y;
-    }
-    
-    if(z != 0)
-    {
-        if(CollideSolids(e, e.x, e.y, e.z + z, typeMask, game)) z = 0;
-        e.z += z;
-    }
-}
-
 static void Update(Player& player, Game& game, float dt)
 {
     if(player.shoot)
@@ -466,7 +186,7 @@ static void Update(Player& player, Game& game, float dt)
             // Maybe we shouldn't move the player y pos directly
             // and just render with the bob
             if(player.lastFrame != 3 && player.frame == 3)
-                Shoot(player.x, 0, player.z, player.lookAngle + ((float)rand() / RAND_MAX) * 0.02f - 0.01f, game);
+                Shoot(player.x, 0, player.z, player.lookAngle + Random(game) * 0.02f - 0.01f, game);
 
             player.lastFrame = player.frame;
         }
@@ -675,7 +395,7 @@ static void Update(Enemy& enemy, float dt, Game& game)
 
 			if (enemy.state == Enemy::IDLE && enemy.stateTimer >= ENEMY_IDLE_TIME)
 			{
-                enemy.lookAngle += ((((float)rand() / RAND_MAX) - 0.5f) * (float)M_PI);
+                enemy.lookAngle += (Random(game) - 0.5f) * (float)M_PI;
 				enemy.stateTimer = 0;
 				enemy.state = Enemy::WALKING;
 			}
@@ -745,43 +465,16 @@ static void Update(Painting& painting, float dt)
     }
 }
 
-void Init(Game& game)
+void InitState(Game& game, const char* levelFilename)
 {
-    SDL_SetRelativeMouseMode(SDL_TRUE);
+    InitState(game, LoadLevel(levelFilename));
+}
 
+void InitState(Game& game, const Level& level)
+{
     game.debugDraw = false;
 
-    game.level = LoadLevel("levels/test.map");
-
-    game.basicShader = LoadShader("shaders/basic.vert", "shaders/basic.frag");
-    game.spriteShader = LoadShader("shaders/sprite.vert", "shaders/sprite.frag");
-
-    game.levelTexture = LoadTexture("textures/wolf.png");
-    
-    // FIXME: This is technically redundant 
-    glBindTexture(GL_TEXTURE_2D, game.levelTexture.id);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    game.doorTexture = LoadTexture("textures/door.png");
-    game.gunTexture = LoadTexture("textures/pistol.png");
-    game.enemyTexture = LoadTexture("textures/guard.png");
-    game.whiteTexture = LoadTexture("textures/white.png");
-    game.paintingTexture = LoadTexture("textures/painting1.png");
-    game.paintingHitTexture = LoadTexture("textures/painting1_hit.png");
-    game.bulletImpactTexture = LoadTexture("textures/bulletimpact.png");
-    game.tracerTexture = LoadTexture("textures/tracer.png");
-
-    game.gunMesh = CreatePlaneMesh();
-    game.enemyMesh = CreatePlaneMesh();
-    game.paintingMesh = LoadMesh("models/painting.obj");
-    game.doorMesh = LoadMesh("models/door.obj");
-    game.boxMesh = LoadMesh("models/box.obj");
-    game.planeMesh = CreatePlaneMesh();
-    game.levelMesh = CreateLevelMesh(game.level, game.levelTexture);
-
-    game.quad = CreateQuad();
+    game.level = level;
 
     game.player.hasbb = true;
     game.player.min = glm::vec3(-0.5f, -1, -0.5f);
@@ -891,21 +584,129 @@ void Init(Game& game)
     }
 }
 
+void InitRender(Game& game)
+{
+    // Decode textures and meshes on the workers while the shaders compile
+    LoadTextureAsync("textures/wolf.png", &game.levelTexture);
+    LoadTextureAsync("textures/door.png", &game.doorTexture);
+    LoadTextureAsync("textures/pistol.png", &game.gunTexture);
+    LoadTextureAsync("textures/guard.png", &game.enemyTexture);
+    LoadTextureAsync("textures/white.png", &game.whiteTexture);
+    LoadTextureAsync("textures/painting1.png", &game.paintingTexture);
+    LoadTextureAsync("textures/painting1_hit.png", &game.paintingHitTexture);
+    LoadTextureAsync("textures/bulletimpact.png", &game.bulletImpactTexture);
+    LoadTextureAsync("textures/tracer.png", &game.tracerTexture);
+
+    LoadMeshAsync("models/painting.msh", &game.paintingMesh);
+    LoadMeshAsync("models/door.msh", &game.doorMesh);
+    LoadMeshAsync("models/box.msh", &game.boxMesh);
+
+    const char* vertexFilenames[] = { "shaders/basic.vert", "shaders/level.vert", "shaders/billboard.vert", "shaders/prop.vert", "shaders/sprite.vert" };
+    const char* fragmentFilenames[] = { "shaders/basic.frag", "shaders/level.frag", "shaders/billboard.frag", "shaders/prop.frag", "shaders/sprite.frag" };
+
+    Shader shaders[COUNT_OF(vertexFilenames)];
+
+    LoadShaders(COUNT_OF(shaders), vertexFilenames, fragmentFilenames, shaders);
+
+    game.basicShader = shaders[0];
+    game.levelShader = shaders[1];
+    game.billboardShader = shaders[2];
+    game.propShader = shaders[3];
+    game.spriteShader = shaders[4];
+
+    // The samplers never change units, so they're only set up once
+    const Shader* unitZeroShaders[] = { &game.basicShader, &game.levelShader, &game.billboardShader, &game.spriteShader };
+
+    for(const Shader* shader : unitZeroShaders)
+    {
+        UseProgram(shader->id);
+        glUniform1i(shader->uniforms[UNIFORM_TEX], 0);
+    }
+
+    const GLint propUnits[PROP_MAX_VARIANTS] = { 0, 1 };
+
+    UseProgram(game.propShader.id);
+    glUniform1iv(game.propShader.uniforms[UNIFORM_TEX], PROP_MAX_VARIANTS, propUnits);
+
+    game.gunMesh = CreatePlaneMesh();
+    game.enemyBatch = CreateBillboardBatch();
+    game.planeMesh = CreatePlaneMesh();
+
+    WaitForLoads();
+
+    // FIXME: This is technically redundant 
+    BindTexture(game.levelTexture.id);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    game.levelMesh = CreateLevelMesh(game.level, game.levelTexture);
+
+    const LevelMesh& levelMesh = game.levelMesh;
+
+    printf("Level mesh: %d planes -> %d quads in %d chunks (%d triangles)\n",
+           game.level.planeCount, levelMesh.mesh.vertexCount / 4, levelMesh.chunkCount,
+           levelMesh.mesh.indexCount / 3);
+
+    game.doorBatch = CreatePropBatch(game.doorMesh);
+    game.paintingBatch = CreatePropBatch(game.paintingMesh);
+
+    game.quad = CreateQuad();
+
+    if(game.level.areaCount > 0)
+        game.visibleAreas = new bool[game.level.areaCount];
+
+    game.enemyInstances = new BillboardInstance[game.enemyCount];
+    game.doorInstances = new PropInstance[game.doorCount];
+    game.paintingInstances = new PropInstance[game.paintingCount];
+}
+
+void Init(Game& game)
+{
+    InitState(game);
+    InitRender(game);
+}
+
+void SeedRandom(Game& game, uint32_t seed)
+{
+    // Xorshift gets stuck at zero
+    game.rngState = seed ? seed : 1;
+}
+
 void Update(Game& game, float dt)
 {
+    PROFILE_SCOPE("Update");
+
     if(WasKeyPressed(SDL_SCANCODE_TAB))
         game.debugDraw = !game.debugDraw;
 
-    Update(game.player, game, dt);
+    {
+        PROFILE_SCOPE("Update player");
+        Update(game.player, game, dt);
+    }
 
-    for(int i = 0; i < game.doorCount; ++i)
-        Update(game.doors[i], dt);
-    
-    for(int i = 0; i < game.enemyCount; ++i)
-        Update(game.enemies[i], dt, game);
+    {
+        PROFILE_SCOPE("Update doors");
 
-    for(int i = 0; i < game.paintingCount; ++i)
-        Update(game.paintings[i], dt);
+        for(int i = 0; i < game.doorCount; ++i)
+            Update(game.doors[i], dt);
+    }
+
+    {
+        PROFILE_SCOPE("Update enemies");
+
+        for(int i = 0; i < game.enemyCount; ++i)
+            Update(game.enemies[i], dt, game);
+    }
+
+    {
+        PROFILE_SCOPE("Update paintings");
+
+        for(int i = 0; i < game.paintingCount; ++i)
+            Update(game.paintings[i], dt);
+    }
+
+    PROFILE_SCOPE("Update effects");
 
     for(int i = 0; i < GAME_MAX_BULLET_IMPACTS; ++i)
         game.impacts[i].life -= dt;
@@ -924,141 +725,329 @@ void Update(Game& game, float dt)
     }
 }
 
-void Draw(const Game& game, const glm::mat4& proj)
+// Walks out from the player's area through doors which are at least
+// partly open, skipping anything the baked PVS says can't be seen
+static void UpdateVisibleAreas(const Game& game, const RenderState& state)
 {
-	glUseProgram(game.basicShader.id);
-    
-    GLuint projLoc = glGetUniformLocation(game.basicShader.id, "proj"); 
-    GLuint texLoc = glGetUniformLocation(game.basicShader.id, "tex");
-	GLuint modelLoc = glGetUniformLocation(game.basicShader.id, "model");
-	GLuint viewLoc = glGetUniformLocation(game.basicShader.id, "view");
+    PROFILE_SCOPE("Visibility");
 
-    // Setup view proj
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(proj));
+    const Level& level = game.level;
 
-    float pitch = game.player.pitch;
-    float yaw = game.player.lookAngle;
+    if(!game.visibleAreas)
+        return;
 
-    glm::vec3 forward = glm::vec3(cosf(pitch) * sinf(yaw), sinf(pitch), cosf(pitch) * cosf(yaw));
+    int start = GetLevelArea(level, state.player.x, state.player.z);
 
-    glm::mat4 view = glm::lookAt(glm::vec3(game.player.x, game.player.y + PLAYER_HEAD_HEIGHT, game.player.z), 
-                                 glm::vec3(game.player.x, game.player.y + PLAYER_HEAD_HEIGHT, game.player.z) + forward, 
-                                 glm::vec3(0, 1, 0));
+    // Outside the level (noclip?), so just draw everything
+    if(start < 0)
+    {
+        for(int i = 0; i < level.areaCount; ++i)
+            game.visibleAreas[i] = true;
 
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    
-    // Draw level
-    glm::mat4 model = glm::translate(glm::vec3(0, -1, 0));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+        return;
+    }
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, game.levelTexture.id);
-        
-    glUniform1i(texLoc, 0);
+    for(int i = 0; i < level.areaCount; ++i)
+        game.visibleAreas[i] = false;
+
+    game.visibleAreas[start] = true;
 
-    Draw(game.levelMesh);
+    // Standing in a doorway sees into both sides
+    for(int i = 0; i < level.portalCount; ++i)
+    {
+        const LevelPortal& portal = level.portals[i];
 
-    // Draw doors
-    glBindTexture(GL_TEXTURE_2D, game.doorTexture.id);
+        if(portal.area != start)
+            continue;
 
-    for(int i = 0; i < game.doorCount; ++i)
+        for(int j = 0; j < 2; ++j)
+        {
+            if(portal.areas[j] >= 0 && IsAreaPotentiallyVisible(level, start, portal.areas[j]))
+                game.visibleAreas[portal.areas[j]] = true;
+        }
+    }
+
+    // Keep going through open doors until nothing new turns up
+    bool changed = true;
+
+    while(changed)
     {
-        glm::mat4 rot = glm::rotate(glm::radians(90.0f * game.doors[i].dir), glm::vec3(0.0f, 1.0f, 0.0f));
+        changed = false;
 
-        model = glm::translate(glm::vec3(game.doors[i].x, game.doors[i].y, game.doors[i].z)) * rot;
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+        for(int i = 0; i < level.portalCount; ++i)
+        {
+            const LevelPortal& portal = level.portals[i];
 
-        Draw(game.doorMesh);
+            for(int j = 0; j < 2; ++j)
+            {
+                int from = portal.areas[j];
+                int to = portal.areas[1 - j];
+
+                if(from < 0 || !game.visibleAreas[from])
+                    continue;
+
+                // The door itself is visible even when it's closed
+                if(IsAreaPotentiallyVisible(level, start, portal.area))
+                    game.visibleAreas[portal.area] = true;
+
+                if(state.doors[portal.door].openness <= 0 || to < 0 || game.visibleAreas[to] ||
+                   !IsAreaPotentiallyVisible(level, start, to))
+                    continue;
+
+                game.visibleAreas[to] = true;
+                changed = true;
+            }
+        }
     }
+}
+
+static bool IsVisible(const Game& game, float x, float z)
+{
+    if(!game.visibleAreas)
+        return true;
+
+    int area = GetLevelArea(game.level, x, z);
+
+    return area < 0 || game.visibleAreas[area];
+}
+
+// Render queue callbacks, item.data is the game and game.drawState is the
+// snapshot being drawn
+
+static void DrawLevel(const RenderQueue& queue, const RenderItem& item)
+{
+    const Game& game = *(const Game*)item.data;
+
+    glUniformMatrix4fv(item.shader->uniforms[UNIFORM_MODEL], 1, GL_FALSE, glm::value_ptr(item.model));
+
+    // Baked levels have every plane facing its open side (see
+    // RemoveHiddenPlanes), so their back faces never need drawing
+    SetCullFace(game.level.areaCount > 0);
+
+    Draw(game.levelMesh, queue.viewProj * item.model, game.visibleAreas);
+
+    SetCullFace(false);
+}
+
+static void DrawEnemies(const RenderQueue& queue, const RenderItem& item)
+{
+    const Game& game = *(const Game*)item.data;
+    const RenderState& state = *game.drawState;
+    const Shader& shader = game.billboardShader;
+
+    // Face the player plane
+    glUniform1f(shader.uniforms[UNIFORM_YAW], state.player.lookAngle - (float)M_PI);
+
+    glUniform2f(shader.uniforms[UNIFORM_FRAME_SIZE],
+                64.0f / game.enemyTexture.width, 64.0f / game.enemyTexture.height);
+    glUniform1i(shader.uniforms[UNIFORM_COLUMNS], game.enemyTexture.width / 64);
+
+    Draw(game.enemyBatch, item.count, game.enemyInstances);
+}
+
+static void DrawDoors(const RenderQueue& queue, const RenderItem& item)
+{
+    const Game& game = *(const Game*)item.data;
+
+    Draw(game.doorBatch, item.count, game.doorInstances);
+}
+
+static void DrawPaintings(const RenderQueue& queue, const RenderItem& item)
+{
+    const Game& game = *(const Game*)item.data;
+
+    Draw(game.paintingBatch, item.count, game.paintingInstances);
+}
+
+static void DrawGun(const RenderQueue& queue, const RenderItem& item)
+{
+    const Game& game = *(const Game*)item.data;
+
+    Draw(game.quad);
+}
+
+// Queues a mesh drawn with the basic shader
+static void SubmitMesh(const Game& game, RenderPass pass, const Mesh& mesh, const Texture& texture, const glm::mat4& model)
+{
+    RenderItem item;
+
+    item.pass = pass;
+    item.shader = &game.basicShader;
+    item.textures[0] = texture.id;
+    item.model = model;
+    item.mesh = &mesh;
+
+    Submit(game.renderQueue, item);
+}
+
+void Draw(const Game& game, const RenderState& state, const glm::mat4& proj)
+{
+    PROFILE_SCOPE("Draw");
+
+    game.drawState = &state;
+
+    UpdateVisibleAreas(game, state);
+
+    float pitch = state.player.pitch;
+    float yaw = state.player.lookAngle;
+
+    glm::vec3 forward = glm::vec3(cosf(pitch) * sinf(yaw), sinf(pitch), cosf(pitch) * cosf(yaw));
+
+    glm::mat4 view = glm::lookAt(glm::vec3(state.player.x, state.player.y + PLAYER_HEAD_HEIGHT, state.player.z), 
+                                 glm::vec3(state.player.x, state.player.y + PLAYER_HEAD_HEIGHT, state.player.z) + forward, 
+                                 glm::vec3(0, 1, 0));
+
+    // Every program reads the camera from here
+    UpdateCamera(proj, view);
+
+    // The sprites are laid out in a fixed size view. Set every frame since
+    // draw.hpp shares the slot for its own view.
+    UpdateCameraViewSize((float)VIEW_WIDTH, (float)VIEW_HEIGHT);
 
-    // Draw enemies
-    glBindTexture(GL_TEXTURE_2D, game.enemyTexture.id);
+    RenderQueue& queue = game.renderQueue;
 
-	for (int i = 0; i < game.enemyCount; ++i)
+    queue.viewProj = proj * view;
+
+    // Level
+    RenderItem item;
+
+    item.shader = &game.levelShader;
+    item.textures[0] = game.levelTexture.id;
+    item.model = glm::translate(glm::vec3(0, -1, 0));
+    item.draw = DrawLevel;
+    item.data = &game;
+
+    Submit(queue, item);
+
+    // Enemies
+    int enemyInstanceCount = 0;
+
+	for (int i = 0; i < state.enemyCount; ++i)
 	{
-        // Draw then facing the player plane
-        glm::mat4 rot = glm::rotate(game.player.lookAngle - (float)M_PI, glm::vec3(0.0f, 1.0f, 0.0f));
+        if(!IsVisible(game, state.enemies[i].x, state.enemies[i].z))
+            continue;
 
         // TODO: Remove this weird constant offset when the enemy dies
-        float y = game.enemies[i].health > 0 ? 0 : -0.1f;
+        float y = state.enemies[i].health > 0 ? 0 : -0.1f;
 
-        glm::mat4 model = glm::translate(glm::vec3(game.enemies[i].x, game.enemies[i].y + y, game.enemies[i].z)) * rot;
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+        BillboardInstance& instance = game.enemyInstances[enemyInstanceCount++];
 
-        PlaneShowFrame(game.enemyMesh, game.enemyTexture, 64, 64, game.enemies[i].frame);
-        Draw(game.enemyMesh);
+        instance.x = state.enemies[i].x;
+        instance.y = state.enemies[i].y + y;
+        instance.z = state.enemies[i].z;
+        instance.frame = (float)state.enemies[i].frame;
 	}
+
+    if(enemyInstanceCount > 0)
+    {
+        item = RenderItem();
+        item.shader = &game.billboardShader;
+        item.textures[0] = game.enemyTexture.id;
+        item.draw = DrawEnemies;
+        item.data = &game;
+        item.count = enemyInstanceCount;
+
+        Submit(queue, item);
+    }
     
-    // Draw paintings
-    for(int i = 0; i < game.paintingCount; ++i)
+    // Doors
+    int doorInstanceCount = 0;
+
+    for(int i = 0; i < state.doorCount; ++i)
+    {
+        if(!IsVisible(game, state.doors[i].sx, state.doors[i].sz))
+            continue;
+
+        glm::mat4 rot = glm::rotate(glm::radians(90.0f * state.doors[i].dir), glm::vec3(0.0f, 1.0f, 0.0f));
+
+        PropInstance& instance = game.doorInstances[doorInstanceCount++];
+
+        instance.model = glm::translate(glm::vec3(state.doors[i].x, state.doors[i].y, state.doors[i].z)) * rot;
+        instance.variant = 0;
+    }
+
+    if(doorInstanceCount > 0)
+    {
+        item = RenderItem();
+        item.shader = &game.propShader;
+        // Doors only have the one texture
+        item.textures[0] = game.doorTexture.id;
+        item.textures[1] = game.doorTexture.id;
+        item.draw = DrawDoors;
+        item.data = &game;
+        item.count = doorInstanceCount;
+
+        Submit(queue, item);
+    }
+
+    // Paintings
+    int paintingInstanceCount = 0;
+
+    for(int i = 0; i < state.paintingCount; ++i)
     {
-        float rads = glm::radians(game.paintings[i].dir * DIR_DEGREES);
+        if(!IsVisible(game, state.paintings[i].x, state.paintings[i].z))
+            continue;
+
+        float rads = glm::radians(state.paintings[i].dir * DIR_DEGREES);
     
         glm::mat4 rot = glm::rotate(rads, glm::vec3(0, 1, 0));
     
         glm::vec3 axis(sinf(rads), 0, cosf(rads));
 
-        glm::mat4 shake = glm::rotate(game.paintings[i].angle, axis);
+        glm::mat4 shake = glm::rotate(state.paintings[i].angle, axis);
 
-        glm::mat4 model = glm::translate(glm::vec3(game.paintings[i].x, game.paintings[i].y, game.paintings[i].z)) * rot * glm::translate(glm::vec3(0, 0.5f, 0)) * shake * glm::translate(glm::vec3(0, -0.5f, 0));
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-            
-        if(!game.paintings[i].hit)
-            glBindTexture(GL_TEXTURE_2D, game.paintingTexture.id);
-        else
-            glBindTexture(GL_TEXTURE_2D, game.paintingHitTexture.id);
+        PropInstance& instance = game.paintingInstances[paintingInstanceCount++];
 
-        Draw(game.paintingMesh);
+        instance.model = glm::translate(glm::vec3(state.paintings[i].x, state.paintings[i].y, state.paintings[i].z)) * rot * glm::translate(glm::vec3(0, 0.5f, 0)) * shake * glm::translate(glm::vec3(0, -0.5f, 0));
+        instance.variant = state.paintings[i].hit ? 1.0f : 0.0f;
     }
 
-    // Draw bullet impacts 
-    glBindTexture(GL_TEXTURE_2D, game.bulletImpactTexture.id);
+    if(paintingInstanceCount > 0)
+    {
+        item = RenderItem();
+        item.shader = &game.propShader;
+        item.textures[0] = game.paintingTexture.id;
+        item.textures[1] = game.paintingHitTexture.id;
+        item.draw = DrawPaintings;
+        item.data = &game;
+        item.count = paintingInstanceCount;
+
+        Submit(queue, item);
+    }
 
+    // Bullet impacts 
     for(int i = 0; i < GAME_MAX_BULLET_IMPACTS; ++i)
     {
-        if(game.impacts[i].life <= 0) continue;
+        if(state.impacts[i].life <= 0) continue;
+        if(!IsVisible(game, state.impacts[i].x, state.impacts[i].z)) continue;
 
-        glm::mat4 rot = glm::rotate(glm::radians(game.impacts[i].dir * DIR_DEGREES), glm::vec3(0, 1, 0)) * glm::translate(glm::vec3(-0.070f, -0.070f, 0));
+        glm::mat4 rot = glm::rotate(glm::radians(state.impacts[i].dir * DIR_DEGREES), glm::vec3(0, 1, 0)) * glm::translate(glm::vec3(-0.070f, -0.070f, 0));
 
-        glm::mat4 model = glm::translate(glm::vec3(game.impacts[i].x, game.impacts[i].y, game.impacts[i].z)) * rot;
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+        glm::mat4 model = glm::translate(glm::vec3(state.impacts[i].x, state.impacts[i].y, state.impacts[i].z)) * rot;
 
-        Draw(game.planeMesh);
+        SubmitMesh(game, RENDER_PASS_OPAQUE, game.planeMesh, game.bulletImpactTexture, model);
     }
     
-    // Draw tracers
-    glBindTexture(GL_TEXTURE_2D, game.tracerTexture.id);
-    
+    // Tracers
     for(int i = 0; i < GAME_MAX_TRACERS; ++i)
     {
-        if(game.tracers[i].life <= 0) continue;
-
-        glm::mat4 rot = glm::rotate(game.tracers[i].shotAngle, glm::vec3(0, 1, 0)) * glm::rotate(glm::radians(90.0f), glm::vec3(1, 0, 0)) * glm::translate(glm::vec3(-0.01f, 0, 0));
+        if(state.tracers[i].life <= 0) continue;
 
-        glm::mat4 trans = glm::translate(glm::vec3(game.tracers[i].x, game.tracers[i].y, game.tracers[i].z));
+        glm::mat4 rot = glm::rotate(state.tracers[i].shotAngle, glm::vec3(0, 1, 0)) * glm::rotate(glm::radians(90.0f), glm::vec3(1, 0, 0)) * glm::translate(glm::vec3(-0.01f, 0, 0));
 
-        glm::mat4 model = trans * rot;
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+        glm::mat4 trans = glm::translate(glm::vec3(state.tracers[i].x, state.tracers[i].y, state.tracers[i].z));
 
-        Draw(game.planeMesh);
+        SubmitMesh(game, RENDER_PASS_OPAQUE, game.planeMesh, game.tracerTexture, trans * rot);
         
         // Draw it twice (once again rotated 90 degrees in local z)
-        rot = glm::rotate(game.tracers[i].shotAngle, glm::vec3(0, 1, 0)) * glm::rotate(glm::radians(90.0f), glm::vec3(0, 0, 1)) * glm::rotate(glm::radians(90.0f), glm::vec3(1, 0, 0)) * glm::translate(glm::vec3(-0.01f, 0, 0));
-
-        model = trans * rot;
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+        rot = glm::rotate(state.tracers[i].shotAngle, glm::vec3(0, 1, 0)) * glm::rotate(glm::radians(90.0f), glm::vec3(0, 0, 1)) * glm::rotate(glm::radians(90.0f), glm::vec3(1, 0, 0)) * glm::translate(glm::vec3(-0.01f, 0, 0));
 
-        Draw(game.planeMesh);
+        SubmitMesh(game, RENDER_PASS_OPAQUE, game.planeMesh, game.tracerTexture, trans * rot);
     }
 
-    if(game.debugDraw)
+    if(state.debugDraw)
     {
-        // Draw box colliders
-        glDisable(GL_DEPTH_TEST);
-
-        glBindTexture(GL_TEXTURE_2D, game.whiteTexture.id);
-
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        // Box colliders
         for (int i = 0; i < game.boxColliderCount; ++i)
         {
             glm::vec3 min = game.boxColliders[i].min;
@@ -1069,79 +1058,61 @@ void Draw(const Game& game, const glm::mat4& proj)
                                                    max.z - min.z));
             
             glm::mat4 model = glm::translate(glm::vec3(game.boxColliders[i].x, game.boxColliders[i].y, game.boxColliders[i].z)) * scale;
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-            Draw(game.boxMesh);
+            SubmitMesh(game, RENDER_PASS_DEBUG, game.boxMesh, game.whiteTexture, model);
         }
 
-        for (int i = 0; i < game.enemyCount; ++i)
+        for (int i = 0; i < state.enemyCount; ++i)
         {
-            glm::vec3 min = game.enemies[i].min;
-            glm::vec3 max = game.enemies[i].max;
+            glm::vec3 min = state.enemies[i].min;
+            glm::vec3 max = state.enemies[i].max;
 
             glm::mat4 scale = glm::scale(glm::vec3(max.x - min.x,
                                                    max.y - min.y,
                                                    max.z - min.z));
             
-            glm::mat4 model = glm::translate(glm::vec3(game.enemies[i].x, game.enemies[i].y, game.enemies[i].z)) * scale;
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            glm::mat4 model = glm::translate(glm::vec3(state.enemies[i].x, state.enemies[i].y, state.enemies[i].z)) * scale;
 
-            Draw(game.boxMesh);
+            SubmitMesh(game, RENDER_PASS_DEBUG, game.boxMesh, game.whiteTexture, model);
         }
-
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-        glEnable(GL_DEPTH_TEST);
     }
 
-    // Setup sprite shader
-
-    glUseProgram(game.spriteShader.id);
- 
-    GLuint spriteTexLoc = glGetUniformLocation(game.spriteShader.id, "tex");
-	GLuint viewSizeLoc = glGetUniformLocation(game.spriteShader.id, "viewSize");
-
-    // Set the view size
-
-    glUniform1i(spriteTexLoc, 0);
-    glUniform2f(viewSizeLoc, (float)VIEW_WIDTH, (float)VIEW_HEIGHT);
-
     // Draw player gun (a sprite)
 
 #if 0
     float x = 0, y = 0, z = 0;
-    Forward(game.player.lookAngle, x, z, 1.2f);
+    Forward(state.player.lookAngle, x, z, 1.2f);
 
     // Get the right vector (which is used to bob the gun across)
     float rx, rz;
-    Forward(game.player.lookAngle - (float)M_PI / 2, rx, rz);
+    Forward(state.player.lookAngle - (float)M_PI / 2, rx, rz);
 
-    float t = sinf(game.player.stride / 2.0f);
+    float t = sinf(state.player.stride / 2.0f);
 
     // If the player isn't shooting (cause the gun must be positioned correctly)
-    if(!game.player.shoot)
+    if(!state.player.shoot)
     {
         x += rx * t * 0.02f;
         z += rz * t * 0.02f;
-        y = sinf(game.player.stride) * 0.01f - 0.01f;
+        y = sinf(state.player.stride) * 0.01f - 0.01f;
     }
         
-    model = glm::translate(glm::vec3(game.player.x + forward.x, game.player.y + forward.y, game.player.z + forward.z)) * glm::scale(glm::vec3(0.5f, 0.5f, 0.5f)) *  
-        glm::rotate(game.player.lookAngle, glm::vec3(0.0f, 1.0f, 0.0f)) *
-        glm::rotate(game.player.pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::translate(glm::vec3(state.player.x + forward.x, state.player.y + forward.y, state.player.z + forward.z)) * glm::scale(glm::vec3(0.5f, 0.5f, 0.5f)) *  
+        glm::rotate(state.player.lookAngle, glm::vec3(0.0f, 1.0f, 0.0f)) *
+        glm::rotate(state.player.pitch, glm::vec3(1.0f, 0.0f, 0.0f));
 
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
-    glBindTexture(GL_TEXTURE_2D, game.gunTexture.id);
+    BindTexture(game.gunTexture.id);
 
-    PlaneShowFrame(game.gunMesh, game.gunTexture, 64, 64, game.player.frame);
+    PlaneShowFrame(game.gunMesh, game.gunTexture, 64, 64, state.player.frame);
 
-    glDisable(GL_DEPTH_TEST); 
+    SetDepthTest(false); 
     Draw(game.gunMesh);
-    glEnable(GL_DEPTH_TEST);
+    SetDepthTest(true);
 #endif
 
-    float t = sinf(game.player.stride / 2.0f);
+    float t = sinf(state.player.stride / 2.0f);
     
 #if 0
     float ox = t * 20.0f;
@@ -1154,28 +1125,128 @@ void Draw(const Game& game, const glm::mat4& proj)
 #if 0
     Update(game.quad, game.gunTexture, 
            VIEW_WIDTH / 2.0f - 32.0f + ox, VIEW_HEIGHT / 2.0f - 32.0f + oy, 128, 128,
-           64, 64, game.player.frame); 
+           64, 64, state.player.frame); 
 #endif
 
-    Update(game.quad, game.gunTexture, VIEW_WIDTH / 2.0f - 256, VIEW_HEIGHT - 512, 512, 512, 64, 64, game.player.frame);
+    Update(game.quad, game.gunTexture, VIEW_WIDTH / 2.0f - 256, VIEW_HEIGHT - 512, 512, 512, 64, 64, state.player.frame);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, game.gunTexture.id);
+    item = RenderItem();
+    item.pass = RENDER_PASS_HUD;
+    item.shader = &game.spriteShader;
+    item.textures[0] = game.gunTexture.id;
+    item.draw = DrawGun;
+    item.data = &game;
 
-    glDisable(GL_DEPTH_TEST);
-    Draw(game.quad);
-    glEnable(GL_DEPTH_TEST);
+    Submit(queue, item);
+
+    FlushRenderQueue(queue);
+
+    game.drawState = nullptr;
 }
 
-void Destroy(Game& game)
+void DestroyState(Game& game)
 {
-    delete game.doors;
-    delete game.enemies;
-    delete game.paintings;
-    delete game.boxColliders;
+    delete[] game.doors;
+    delete[] game.enemies;
+    delete[] game.paintings;
+    delete[] game.boxColliders;
 
     DestroyLevel(game.level);
+}
+
+void DestroyRender(Game& game)
+{
+    delete[] game.enemyInstances;
+    delete[] game.doorInstances;
+    delete[] game.paintingInstances;
+    delete[] game.visibleAreas;
 
     DestroyMesh(game.gunMesh);
-    DestroyMesh(game.levelMesh);
+    DestroyBillboardBatch(game.enemyBatch);
+    DestroyPropBatch(game.doorBatch);
+    DestroyPropBatch(game.paintingBatch);
+    DestroyLevelMesh(game.levelMesh);
+
+    DestroyRenderQueue(game.renderQueue);
+}
+
+void Destroy(Game& game)
+{
+    DestroyRender(game);
+    DestroyState(game);
+}
+
+void CreateRenderState(const Game& game, RenderState& state)
+{
+    state.doorCount = game.doorCount;
+    state.doors = new Door[game.doorCount];
+
+    state.enemyCount = game.enemyCount;
+    state.enemies = new Enemy[game.enemyCount];
+
+    state.paintingCount = game.paintingCount;
+    state.paintings = new Painting[game.paintingCount];
+
+    Snapshot(game, state);
+}
+
+void Snapshot(const Game& game, RenderState& state)
+{
+    state.player = game.player;
+    state.debugDraw = game.debugDraw;
+
+    // Entities are never added or removed after Init
+    std::copy(game.doors, game.doors + game.doorCount, state.doors);
+    std::copy(game.enemies, game.enemies + game.enemyCount, state.enemies);
+    std::copy(game.paintings, game.paintings + game.paintingCount, state.paintings);
+
+    std::copy(game.impacts, game.impacts + GAME_MAX_BULLET_IMPACTS, state.impacts);
+    std::copy(game.tracers, game.tracers + GAME_MAX_TRACERS, state.tracers);
+}
+
+template<typename T>
+static void Lerp(T& state, const T& prev, float alpha)
+{
+    state.x = glm::mix(prev.x, state.x, alpha);
+    state.y = glm::mix(prev.y, state.y, alpha);
+    state.z = glm::mix(prev.z, state.z, alpha);
+}
+
+void Interpolate(const RenderState& prev, float alpha, RenderState& state)
+{
+    Lerp(state.player, prev.player, alpha);
+
+    // Look angles aren't wrapped, so a plain mix is fine
+    state.player.pitch = glm::mix(prev.player.pitch, state.player.pitch, alpha);
+    state.player.lookAngle = glm::mix(prev.player.lookAngle, state.player.lookAngle, alpha);
+    state.player.stride = glm::mix(prev.player.stride, state.player.stride, alpha);
+
+    // Animation frames, health and so on just snap to the latest tick
+    for(int i = 0; i < state.doorCount; ++i)
+        Lerp(state.doors[i], prev.doors[i], alpha);
+
+    for(int i = 0; i < state.enemyCount; ++i)
+        Lerp(state.enemies[i], prev.enemies[i], alpha);
+
+    for(int i = 0; i < state.paintingCount; ++i)
+        state.paintings[i].angle = glm::mix(prev.paintings[i].angle, state.paintings[i].angle, alpha);
+
+    // Impacts don't move. Tracers which were only just fired (or reused a
+    // slot) have nothing to blend from.
+    for(int i = 0; i < GAME_MAX_TRACERS; ++i)
+    {
+        if(prev.tracers[i].life <= 0 || prev.tracers[i].life < state.tracers[i].life)
+            continue;
+
+        Lerp(state.tracers[i], prev.tracers[i], alpha);
+    }
+}
+
+void DestroyRenderState(RenderState& state)
+{
+    delete[] state.doors;
+    delete[] state.enemies;
+    delete[] state.paintings;
+
+    state = RenderState();
 }
@@ -0,0 +1,178 @@
+#include <SDL.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.hpp"
+#include "game.hpp"
+#include "input.hpp"
+#include "replay.hpp"
+#include "pack.hpp"
+
+// Runs the simulation without a window or GL context and reports how fast
+// it goes. Meant for measuring Update on machines without a display.
+//
+// game_headless [--ticks N] [--tickrate N] [--level path] [--seed N]
+//               [--replay file] [--record file]
+//
+// Without --replay the input comes from a built-in script. A replay runs
+// until the recording ends (or --ticks), with the recorded seed and dt.
+
+static const int HEADLESS_DEFAULT_TICKS = 100000;
+
+// Seconds each step of the script lasts
+static const float SCRIPT_STEP_TIME = 2.0f;
+
+// Walks, strafes, looks around, shoots and opens doors in a loop so every
+// part of Update gets some work
+static void ScriptInput(int tick, int tickRate, InputFrame& frame)
+{
+    frame = InputFrame();
+
+    int step = (int)(tick / (SCRIPT_STEP_TIME * tickRate)) % 4;
+
+    switch(step)
+    {
+        case 0:
+            frame.keys[SDL_SCANCODE_W] = 1;
+            frame.mouseX = 4;
+            break;
+
+        case 1:
+            frame.keys[SDL_SCANCODE_A] = 1;
+            frame.shoot = true;
+            break;
+
+        case 2:
+            frame.keys[SDL_SCANCODE_S] = 1;
+            frame.keys[SDL_SCANCODE_D] = 1;
+            frame.mouseX = -6;
+            break;
+
+        case 3:
+            frame.keys[SDL_SCANCODE_W] = 1;
+            frame.shoot = true;
+            break;
+    }
+
+    // Tap use every half second
+    if(tick % (tickRate / 2 + 1) == 0)
+        frame.keys[SDL_SCANCODE_E] = 1;
+}
+
+int main(int argc, char** argv)
+{
+    int tickCount = 0;
+    int tickRate = GAME_DEFAULT_TICK_RATE;
+    uint32_t seed = 1;
+    const char* level = GAME_DEFAULT_LEVEL;
+    const char* replayFilename = nullptr;
+    const char* recordFilename = nullptr;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--ticks") == 0 && i + 1 < argc)
+            tickCount = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--tickrate") == 0 && i + 1 < argc)
+            tickRate = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--level") == 0 && i + 1 < argc)
+            level = argv[++i];
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replayFilename = argv[++i];
+        else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordFilename = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--ticks N] [--tickrate N] [--level path] [--seed N] [--replay file] [--record file]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(tickCount <= 0)
+        tickCount = replayFilename ? INT_MAX : HEADLESS_DEFAULT_TICKS;
+
+    if(tickRate <= 0)
+        CRASH("Tick rate must be positive\n");
+
+    InputReplay replay;
+
+    if(replayFilename)
+    {
+        replay = OpenInputReplay(replayFilename);
+        seed = replay.seed;
+    }
+
+    InputRecorder recorder;
+
+    if(recordFilename)
+        recorder = CreateInputRecorder(recordFilename, seed);
+
+    if(!OpenPack("assets.pak"))
+        printf("No asset pack found, loading loose files\n");
+
+    Game game;
+
+    InitState(game, level);
+    SeedRandom(game, seed);
+
+    float dt = 1.0f / tickRate;
+
+    InputFrame frame;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    int ticksRun = 0;
+
+    for(; ticksRun < tickCount; ++ticksRun)
+    {
+        float tickDt = dt;
+
+        if(replay.file)
+        {
+            if(!NextReplayFrame(replay, frame, tickDt))
+                break;
+        }
+        else
+            ScriptInput(ticksRun, tickRate, frame);
+
+        UpdateInput(frame);
+
+        if(recorder.file)
+            Record(recorder, frame, tickDt);
+
+        Update(game, tickDt);
+    }
+
+    double seconds = (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+    tickCount = ticksRun;
+
+    int result = 0;
+
+    // An empty or truncated replay runs nothing, which mustn't pass
+    if(tickCount == 0)
+    {
+        fprintf(stderr, "No ticks were run\n");
+        result = 1;
+    }
+    else
+    {
+        printf("%d ticks in %.3f s (%.0f ticks/s, %.2f us/tick)\n",
+               tickCount, seconds, tickCount / seconds, seconds * 1000000.0 / tickCount);
+
+        // Same input and seed should always end up here
+        printf("Player ended at %f %f %f\n", game.player.x, game.player.y, game.player.z);
+    }
+
+    CloseInputReplay(replay);
+    DestroyInputRecorder(recorder);
+
+    DestroyState(game);
+
+    ClosePack();
+
+    return result;
+}
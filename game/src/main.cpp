@@ -3,66 +3,388 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
 
 #include "utils.hpp"
 #include "game.hpp"
+#include "draw.hpp"
+#include "glstate.hpp"
+#include "profile.hpp"
+#include "stream.hpp"
 #include "input.hpp"
+#include "replay.hpp"
+#include "jobs.hpp"
+#include "loader.hpp"
+#include "pack.hpp"
 #include "context.hpp"
 
 static const int WINDOW_WIDTH = 640;
 static const int WINDOW_HEIGHT = 480;
 
+// Pipelined mode (--pipelined): the main thread polls events and updates
+// the game, the render thread owns the GL context and draws the last
+// published snapshot. Update for frame N + 1 overlaps Draw for frame N.
+static struct
+{
+    std::thread thread;
+
+    std::mutex mutex;
+    // Signalled when a snapshot is published or on quit
+    std::condition_variable published;
+    // Signalled when the render thread takes a snapshot
+    std::condition_variable taken;
+
+    // The main thread writes states[back] while the render thread draws
+    // the other one
+    RenderState states[2];
+    int back = 0;
+
+    // A snapshot is waiting for the render thread
+    bool pending = false;
+    bool quit = false;
+
+    // Window size to apply on the render thread, 0 if unchanged
+    int viewportWidth = 0, viewportHeight = 0;
+} Pipeline;
+
+// Profiler stats drawn over the game, toggled with F3. F4 writes the
+// recorded frames to PROFILE_TRACE_FILENAME.
+static const char* PROFILE_TRACE_FILENAME = "profile.json";
+
+static struct
+{
+    Font font;
+
+    // Toggled on the main thread, read by whichever thread draws
+    std::atomic<bool> visible{false};
+} Overlay;
+
+static void RenderFrame(const Context& context, const Game& game, const RenderState& state)
+{
+    // Finish any assets requested after startup
+    {
+        PROFILE_SCOPE("Loader");
+        UpdateLoader();
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), context.viewWidth / context.viewHeight, 0.2f, 100.0f);
+
+    Draw(game, state, proj);
+
+    if(Overlay.visible)
+    {
+        SetDepthTest(false);
+
+        // Draw left the game's sprite view size in the Camera block
+        SetViewSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+        DrawProfileOverlay(Overlay.font, 8, 8);
+        FlushDraw();
+
+        SetDepthTest(true);
+    }
+
+    EndStreamFrame();
+
+    PROFILE_SCOPE("Swap");
+
+    SDL_GL_SwapWindow(context.window);
+}
+
+static void RenderMain(const Context* context, const Game* game)
+{
+    PROFILE_THREAD("Render");
+
+    SDL_GL_MakeCurrent(context->window, context->glContext);
+
+    while(true)
+    {
+        int index, width, height;
+
+        {
+            std::unique_lock<std::mutex> lock(Pipeline.mutex);
+            Pipeline.published.wait(lock, [] { return Pipeline.pending || Pipeline.quit; });
+
+            if(!Pipeline.pending)
+                break;
+
+            // The main thread has already moved on to the other one
+            index = 1 - Pipeline.back;
+            Pipeline.pending = false;
+
+            width = Pipeline.viewportWidth;
+            height = Pipeline.viewportHeight;
+            Pipeline.viewportWidth = Pipeline.viewportHeight = 0;
+        }
+
+        Pipeline.taken.notify_one();
+
+        if(width > 0)
+            glViewport(0, 0, width, height);
+
+        RenderFrame(*context, *game, Pipeline.states[index]);
+    }
+
+    // Hand the context back for shutdown
+    SDL_GL_MakeCurrent(context->window, nullptr);
+}
+
+// Snapshot of the game for drawing, blended back towards the tick before
+static void Capture(const Game& game, const RenderState& prev, float alpha, RenderState& state)
+{
+    Snapshot(game, state);
+    Interpolate(prev, alpha, state);
+}
+
+// Captures the game into the back snapshot and hands it to the render thread
+static void Publish(const Game& game, const RenderState& prev, float alpha)
+{
+    std::unique_lock<std::mutex> lock(Pipeline.mutex);
+
+    // Once the last snapshot is taken the render thread is done with
+    // the back one. This also keeps us at most a frame ahead.
+    Pipeline.taken.wait(lock, [] { return !Pipeline.pending; });
+
+    Capture(game, prev, alpha, Pipeline.states[Pipeline.back]);
+
+    Pipeline.back = 1 - Pipeline.back;
+    Pipeline.pending = true;
+
+    lock.unlock();
+    Pipeline.published.notify_one();
+}
+
 int main(int argc, char** argv)
 {
+    bool pipelined = false;
+    int tickRate = GAME_DEFAULT_TICK_RATE;
+
+    const char* recordFilename = nullptr;
+    const char* replayFilename = nullptr;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--pipelined") == 0)
+            pipelined = true;
+        else if(strcmp(argv[i], "--tickrate") == 0 && i + 1 < argc)
+            tickRate = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordFilename = argv[++i];
+        else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replayFilename = argv[++i];
+    }
+
+    if(tickRate <= 0)
+        CRASH("Tick rate must be positive\n");
+
     Context context = CreateContext("Wolf3D", WINDOW_WIDTH, WINDOW_HEIGHT, CONTEXT_SCALE_STRETCH);
 
 	SDL_Event event;
 	bool running = true;
 
-	glEnable(GL_DEPTH_TEST);
+	SetDepthTest(true);
     glDepthFunc(GL_LESS);
 
-    // TODO: Enable back-face culling and handle walls properly
+    // Back-face culling is only enabled for the level pass (see Draw in game.cpp)
+
+    // Asset decoding and other CPU work scales with the core count
+    InitJobs();
+
+    if(!OpenPack("assets.pak"))
+        printf("No asset pack found, loading loose files\n");
+
+    SDL_SetRelativeMouseMode(SDL_TRUE);
 
     Game game;
     
     Init(game);
 
+    // Only the profiler overlay draws in 2D
+    InitDraw(WINDOW_WIDTH, WINDOW_HEIGHT);
+    Overlay.font = LoadFont("fonts/consola.ttf", 14.0f);
+
+    InputReplay replay;
+    InputRecorder recorder;
+
+    // A replay makes the same random choices as the recorded session
+    uint32_t seed = (uint32_t)SDL_GetPerformanceCounter();
+
+    if(replayFilename)
+    {
+        replay = OpenInputReplay(replayFilename);
+        seed = replay.seed;
+    }
+
+    SeedRandom(game, seed);
+
+    if(recordFilename)
+        recorder = CreateInputRecorder(recordFilename, seed);
+
+    for(int i = 0; i < 2; ++i)
+        CreateRenderState(game, Pipeline.states[i]);
+
+    // The game as of the tick before the latest one
+    RenderState prev;
+    CreateRenderState(game, prev);
+
+    // Counter ticks per simulation tick
+    Uint64 tickLength = SDL_GetPerformanceFrequency() / tickRate;
+    Uint64 accumulator = 0;
+
+    float dt = 1.0f / tickRate;
+
     Uint64 ticks = SDL_GetPerformanceCounter();
     
     glClearColor(0, 0, 0, 1.0f);
+
+    if(pipelined)
+    {
+        // The render thread makes it current again
+        SDL_GL_MakeCurrent(context.window, nullptr);
+
+        Pipeline.thread = std::thread(RenderMain, &context, &game);
+    }
 	
+    PROFILE_THREAD("Main");
+
     while(running)
     {
+        PROFILE_FRAME();
+
+        PROFILE_BEGIN("Events");
+
         while(SDL_PollEvent(&event))
         {
             if(event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE))
                 running = false;
+            // Handled here rather than through input.hpp so they never end
+            // up in a recording
+            else if(event.type == SDL_KEYDOWN && !event.key.repeat && event.key.keysym.sym == SDLK_F3)
+                Overlay.visible = !Overlay.visible;
+            else if(event.type == SDL_KEYDOWN && !event.key.repeat && event.key.keysym.sym == SDLK_F4)
+                WriteProfileTrace(PROFILE_TRACE_FILENAME);
             else if(event.type == SDL_WINDOWEVENT)
             {
                 if(event.window.event == SDL_WINDOWEVENT_RESIZED)
-                    glViewport(0, 0, event.window.data1, event.window.data2);
+                {
+                    if(pipelined)
+                    {
+                        std::lock_guard<std::mutex> lock(Pipeline.mutex);
+
+                        Pipeline.viewportWidth = event.window.data1;
+                        Pipeline.viewportHeight = event.window.data2;
+                    }
+                    else
+                        glViewport(0, 0, event.window.data1, event.window.data2);
+                }
             }
         }
 
-        UpdateInput();
+        PROFILE_END();
 
-        Uint64 elapsed = SDL_GetPerformanceCounter() - ticks;
-        ticks = SDL_GetPerformanceCounter();
+        Uint64 now = SDL_GetPerformanceCounter();
 
-        float dt = elapsed / (float)SDL_GetPerformanceFrequency();
-        
-        Update(game, dt);
+        accumulator += now - ticks;
+        ticks = now;
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        int tickCount = 0;
 
-        glm::mat4 proj = glm::perspective(glm::radians(45.0f), context.viewWidth / context.viewHeight, 0.2f, 100.0f);
+        while(accumulator >= tickLength)
+        {
+            // Past the cap we'd never catch up, so just drop the rest
+            if(tickCount == GAME_MAX_TICKS_PER_FRAME)
+            {
+                accumulator %= tickLength;
+                break;
+            }
 
-        Draw(game, proj);
+            Snapshot(game, prev);
 
-        SDL_GL_SwapWindow(context.window);
+            float tickDt = dt;
+
+            PROFILE_BEGIN("Input");
+
+            // Per tick so key presses are seen by exactly one tick
+            if(replay.file)
+            {
+                InputFrame frame;
+
+                if(!NextReplayFrame(replay, frame, tickDt))
+                {
+                    printf("Replay finished after %d ticks\n", replay.frameCount);
+
+                    PROFILE_END();
+
+                    running = false;
+                    break;
+                }
+
+                UpdateInput(frame);
+            }
+            else
+                UpdateInput();
+
+            if(recorder.file)
+                Record(recorder, GetInputFrame(), tickDt);
+
+            PROFILE_END();
+
+            Update(game, tickDt);
+
+            accumulator -= tickLength;
+            tickCount += 1;
+        }
+
+        float alpha = accumulator / (float)tickLength;
+
+        if(pipelined)
+        {
+            PROFILE_SCOPE("Publish");
+            Publish(game, prev, alpha);
+        }
+        else
+        {
+            Capture(game, prev, alpha, Pipeline.states[0]);
+            RenderFrame(context, game, Pipeline.states[0]);
+        }
+    }
+
+    if(pipelined)
+    {
+        {
+            std::lock_guard<std::mutex> lock(Pipeline.mutex);
+            Pipeline.quit = true;
+        }
+
+        Pipeline.published.notify_one();
+        Pipeline.thread.join();
+
+        SDL_GL_MakeCurrent(context.window, context.glContext);
     }
 
+    for(int i = 0; i < 2; ++i)
+        DestroyRenderState(Pipeline.states[i]);
+
+    DestroyRenderState(prev);
+
+    DestroyFont(Overlay.font);
+    DestroyDraw();
+
+    CloseInputReplay(replay);
+    DestroyInputRecorder(recorder);
+
+    DestroyLoader();
+    DestroyJobs();
+
+    ClosePack();
+
     DestroyContext(context);
 
     return 0;